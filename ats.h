@@ -13,6 +13,12 @@
 #define ATS_API extern
 #endif
 
+#if defined(_MSC_VER)
+#define ATS_THREAD_LOCAL __declspec(thread)
+#else
+#define ATS_THREAD_LOCAL _Thread_local
+#endif
+
 #define PI  (3.14159265359f)
 #define TAU (6.28318530718f)
 
@@ -35,7 +41,7 @@
 #define align_down(n, a)      ((n) & ~((a) - 1))
 #define align_up(n, a)        align_down((n) + (a) - 1, (a))
 #define align_down_ptr(p, a)  ((void*)align_down((uintptr_t)(p), (a)))
-#define align_up_ptr(p, a)    ((void*)align_down((uintptr_t)(p), (a)))
+#define align_up_ptr(p, a)    ((void*)align_up((uintptr_t)(p), (a)))
 
 #define clamp_min(n, min)      ((n) < (min)? (min) : (n))
 #define clamp_max(n, max)      ((n) > (max)? (max) : (n))
@@ -491,10 +497,54 @@ ATS_API m4 m4_invert(m4 m); // assumes it is invertible
 // ------------------------------------- implementation in ats_mem.c ------------------------------- //
 // ================================================================================================= //
 
-#define MEM_KIB(n) (1024 * (n))
+#define MEM_KIB(n) (1024ull * (n))
 #define MEM_MIB(n) (1024 * MEM_KIB(n))
 #define MEM_GIB(n) (1024 * MEM_MIB(n))
 
+#ifndef MEM_COMMIT_SIZE
+#define MEM_COMMIT_SIZE MEM_KIB(64)   // granularity used when committing reserved arenas
+#endif
+
+#ifndef MEM_DECOMMIT_SLACK
+#define MEM_DECOMMIT_SLACK MEM_MIB(1) // bytes kept committed above pos by mem_trim
+#endif
+
+#ifndef MEM_SCRATCH_SIZE
+#define MEM_SCRATCH_SIZE MEM_GIB(1)   // address space reserved per scratch arena
+#endif
+
+#ifndef MEM_FRAME_SIZE
+#define MEM_FRAME_SIZE MEM_GIB(1)     // address space reserved per frame arena
+#endif
+
+#ifndef MEM_FRAME_TRIM_SWAPS
+#define MEM_FRAME_TRIM_SWAPS (120)    // swaps in a row a frame arena must use under half its pages before it is trimmed
+#endif
+
+#ifndef MEM_TEMP_SIZE
+#define MEM_TEMP_SIZE MEM_MIB(4)      // bytes guaranteed writable after mem_begin on reserved arenas
+#endif
+
+#ifndef MEM_DEFAULT_ALIGN
+#define MEM_DEFAULT_ALIGN (16)
+#endif
+
+enum {
+  MEM_FLAG_RESERVE    = (1 << 0),
+  MEM_FLAG_LAZY_ZERO  = (1 << 1), // memory past 'dirty' is known to be zero, set by mem_reserve
+  MEM_FLAG_CONCURRENT = (1 << 2), // set by mem_set_concurrent
+};
+
+#ifndef MEM_CONCURRENT_CHUNK
+#define MEM_CONCURRENT_CHUNK MEM_KIB(32) // bytes each thread grabs at a time from a concurrent arena
+#endif
+
+// flags for mem_alloc / mem_type / mem_array, ex: mem_type(sm_node, .flags = MEM_ALLOC_NO_HEADER)
+enum {
+  MEM_ALLOC_NO_HEADER = (1 << 0), // NOTE: mem_size / mem_count are not valid for these
+  MEM_ALLOC_NO_ZERO   = (1 << 1), // NOTE: contents are undefined
+};
+
 typedef struct mem_index mem_index;
 struct mem_index {
   usize pos;
@@ -502,10 +552,22 @@ struct mem_index {
 };
 
 typedef struct mem_arena mem_arena;
+
+// a saved arena position, unlike mem_save it doesn't allocate anything.
+typedef struct {
+  mem_arena* arena;
+  usize pos;
+} mem_mark;
+
 struct mem_arena {
   usize pos;
   usize cap;
   usize max;
+  usize commit;
+  usize dirty;
+  u32 flags;
+  u32 generation;
+  volatile i32 lock;
   u8* buf;
 
   mem_index* stack;
@@ -514,24 +576,124 @@ struct mem_arena {
 
 ATS_API void mem_init(void* data, usize size);
 ATS_API mem_arena mem_create(void* data, usize size);
+ATS_API mem_arena mem_reserve(usize size); // NOTE: reserves address space, pages are committed as pos grows
+ATS_API void mem_release(mem_arena* arena);
 ATS_API void mem_push(mem_arena* arena);
 ATS_API void mem_pop(void);
 ATS_API usize mem_max(void);
 
-#define mem_alloc(...)                  mem__alloc((mem__alloc_desc) { __VA_ARGS__ })
-#define mem_type(type, ...)             (type*)mem_alloc((sizeof (type)), 0, __VA_ARGS__)
-#define mem_array(type, count, ...)     (type*)mem_alloc(((count) * sizeof (type)), (usize)(count), __VA_ARGS__)
-
+// NOTE: the arena stack and scratch arenas are thread local.
+// mem_scratch returns one of two per-thread scratch arenas that isn't 'conflict',
+// so a function can use scratch memory while its caller's result lives in the other one.
+ATS_API mem_arena* mem_scratch(mem_arena* conflict);
+ATS_API void mem_scratch_release(void); // call before a worker thread exits
+
+// two frame arenas that trade places every mem_frame_swap (called by platform_update).
+// data allocated from mem_frame() in frame N can still be read through mem_frame_last() in frame N + 1.
+// pages stay committed across swaps, they are only given back after MEM_FRAME_TRIM_SWAPS low swaps.
+ATS_API mem_arena* mem_frame(void);
+ATS_API mem_arena* mem_frame_last(void);
+ATS_API void mem_frame_swap(void);
+
+ATS_API void mem_rewind(mem_mark mark);
+
+// rewinding keeps pages committed, mem_trim gives back the ones past pos + MEM_DECOMMIT_SLACK.
+// call it after a spike, not per scope, since the next allocations fault the pages in again.
+ATS_API void mem_trim(mem_arena* arena);
+
+// lets many threads mem_alloc from the same arena. each thread bumps its own MEM_CONCURRENT_CHUNK
+// sized chunk and only touches the shared pos with an atomic add when the chunk runs out.
+// NOTE: pass the arena explicitly instead of pushing it, and only call mem_save / mem_restore
+// while no other thread is allocating from it. mem_begin / mem_end are not supported.
+ATS_API void mem_set_concurrent(mem_arena* arena);
+
+#ifdef ATS_MEM_TRACE
+#define mem_alloc(...)          mem__alloc_trace((mem__alloc_desc) { __VA_ARGS__ }, __FILE__, __LINE__)
+#define mem_context(arena)      scope_guard(mem__push_trace((arena), __FILE__, __LINE__), mem__pop_trace())
+#define mem_save(...)           mem__save_trace((mem__arena_desc) { 0, __VA_ARGS__ }, __FILE__, __LINE__)
+#define mem_restore(...)        mem__restore_trace((mem__arena_desc) { 0, __VA_ARGS__ })
+#define mem_mark(...)           mem__mark_trace((mem__arena_desc) { 0, __VA_ARGS__ }, __FILE__, __LINE__)
+#define mem__rewind_scope       mem__rewind_trace
+#else
+#define mem_alloc(...)          mem__alloc((mem__alloc_desc) { __VA_ARGS__ })
 #define mem_context(arena)      scope_guard(mem_push(arena), mem_pop())
 #define mem_save(...)           mem__save((mem__arena_desc) { 0, __VA_ARGS__ })
 #define mem_restore(...)        mem__restore((mem__arena_desc) { 0, __VA_ARGS__ })
+#define mem_mark(...)           mem__mark((mem__arena_desc) { 0, __VA_ARGS__ })
+#define mem__rewind_scope       mem_rewind
+#endif
+
+// ex: mem_array(v4, 1024, arena, 64) or mem_type(counter, .align = 64)
+// size and count are designated so the rest can be left out without -Wmissing-field-initializers.
+#define mem_type(type, ...)             (type*)mem_alloc(.size = (sizeof (type)), .count = 0, __VA_ARGS__)
+#define mem_array(type, n, ...)         (type*)mem_alloc(.size = ((n) * sizeof (type)), .count = (usize)(n), __VA_ARGS__)
+
+#define mem_scratch_scope(arena, conflict) \
+  for (mem_arena* arena = mem_scratch(conflict); arena; arena = 0) \
+  mem_scope(arena)
 #define mem_begin(...)          mem__begin((mem__arena_desc) { 0, __VA_ARGS__ })
 #define mem_end(size, ...)      mem__end((size), (mem__arena_desc) { 0, __VA_ARGS__ })
 #define mem_temp                mem_begin
-#define mem_scope(...)          scope_guard(mem__save((mem__arena_desc) { 0, __VA_ARGS__ }), mem__restore((mem__arena_desc) { 0, __VA_ARGS__ }))
+#define mem_scope(...) \
+  for (mem_mark macro_var(mark) = mem_mark(__VA_ARGS__), *macro_var(once) = &macro_var(mark); \
+       macro_var(once); \
+       mem__rewind_scope(macro_var(mark)), macro_var(once) = 0)
 #define mem_size(ptr)           ((mem_header*)(ptr) - 1)->size
 #define mem_count(ptr)          ((mem_header*)(ptr) - 1)->count
 
+// ------------------- trace ------------------ //
+// compile with ATS_MEM_TRACE to record bytes and count per mem_alloc call site
+// and the peak usage of every mem_scope / mem_save / mem_context site.
+
+#ifndef MEM_TRACE_SITES
+#define MEM_TRACE_SITES (4096)
+#endif
+
+#ifdef ATS_MEM_TRACE
+ATS_API void mem_trace_report(FILE* out); // sorted by bytes / peak, largest first
+ATS_API void mem_trace_reset(void);
+#endif
+
+// ------------------- pool ------------------- //
+// fixed size blocks carved out of an arena, freed blocks go on an intrusive free list.
+// mem_pool_alloc / mem_pool_free are not thread safe. threads sharing a pool should each
+// own a mem_pool_cache and only go through that, blocks are moved to/from the pool in batches.
+// NOTE: the pool grows its arena while holding the pool lock, so give shared pools their own arena.
+
+#ifndef MEM_POOL_CHUNK
+#define MEM_POOL_CHUNK (64)       // blocks allocated from the arena at a time
+#endif
+
+#ifndef MEM_POOL_CACHE_SIZE
+#define MEM_POOL_CACHE_SIZE (32)  // max blocks held by a mem_pool_cache
+#endif
+
+typedef struct mem_pool mem_pool;
+struct mem_pool {
+  usize size;
+  usize align;
+  usize count; // blocks handed out, including the ones sitting in caches
+  mem_arena* arena;
+  void* free;
+  volatile i32 lock;
+};
+
+typedef struct {
+  mem_pool* pool;
+  void* free;
+  u32 count;
+} mem_pool_cache;
+
+#define mem_pool(type, ...) mem__pool_create((mem__pool_desc) { sizeof (type), __VA_ARGS__ })
+
+ATS_API void* mem_pool_alloc(mem_pool* pool); // NOTE: returns zeroed memory
+ATS_API void  mem_pool_free(mem_pool* pool, void* ptr);
+
+ATS_API mem_pool_cache mem_pool_cache_create(mem_pool* pool);
+ATS_API void* mem_pool_cache_alloc(mem_pool_cache* cache);
+ATS_API void  mem_pool_cache_free(mem_pool_cache* cache, void* ptr);
+ATS_API void  mem_pool_cache_flush(mem_pool_cache* cache); // call before a worker thread exits
+
 // -------------------- internal --------------- //
 
 typedef struct {
@@ -539,10 +701,18 @@ typedef struct {
   mem_arena* arena;
 } mem__arena_desc;
 
+typedef struct {
+  usize size;
+  mem_arena* arena; // defaults to the top of the arena stack
+  usize align;
+} mem__pool_desc;
+
 typedef struct {
   usize size;
   usize count;
   mem_arena* arena;
+  usize align; // power of two, defaults to MEM_DEFAULT_ALIGN
+  u32 flags;
 } mem__alloc_desc;
 
 ATS_API void* mem__alloc(mem__alloc_desc desc);
@@ -550,6 +720,18 @@ ATS_API void  mem__save(mem__arena_desc desc);
 ATS_API void  mem__restore(mem__arena_desc desc);
 ATS_API void* mem__begin(mem__arena_desc desc);
 ATS_API void  mem__end(usize size, mem__arena_desc desc);
+ATS_API mem_pool mem__pool_create(mem__pool_desc desc);
+ATS_API mem_mark mem__mark(mem__arena_desc desc);
+
+#ifdef ATS_MEM_TRACE
+ATS_API void* mem__alloc_trace(mem__alloc_desc desc, const char* file, i32 line);
+ATS_API void  mem__save_trace(mem__arena_desc desc, const char* file, i32 line);
+ATS_API void  mem__restore_trace(mem__arena_desc desc);
+ATS_API mem_mark mem__mark_trace(mem__arena_desc desc, const char* file, i32 line);
+ATS_API void  mem__rewind_trace(mem_mark mark);
+ATS_API void  mem__push_trace(mem_arena* arena, const char* file, i32 line);
+ATS_API void  mem__pop_trace(void);
+#endif
 
 // ================================================= DS ============================================= //
 // ------------------------------------- implementation in ats_ds.c --------------------------------- //
@@ -559,6 +741,42 @@ ATS_API void bit_set(u32* array, u32 index);
 ATS_API b32  bit_get(u32* array, u32 index);
 ATS_API void bit_clr(u32* array, u32 index);
 
+// fixed size set of bits with whole set operations, word_count is padded to whole BITSET_BLOCK
+// blocks so the AVX2 loops have no tail. bits past 'count' always stay 0.
+//
+// Example:
+// bitset_and(&out, &visible, &alive);
+// bitset_and(&out, &out, &in_range);
+//
+// bitset_for(&out, i) {
+//   draw(entities[i]);
+// }
+
+#define BITSET_BLOCK (4) // u64 words per AVX2 register
+
+typedef struct {
+  u32 count;
+  u32 word_count;
+  u64* words;
+} bitset;
+
+#define bitset_for(set, index) \
+  for (u32 index = bitset_next((set), 0); index < (set)->count; index = bitset_next((set), index + 1))
+
+ATS_API bitset bitset_create(mem_arena* arena, u32 count); // all bits clear
+ATS_API void bitset_set(bitset* set, u32 index);
+ATS_API b32 bitset_get(const bitset* set, u32 index);
+ATS_API void bitset_clr(bitset* set, u32 index);
+ATS_API void bitset_fill(bitset* set, u32 begin, u32 end);  // sets [begin, end)
+ATS_API void bitset_clear(bitset* set, u32 begin, u32 end); // clears [begin, end)
+// out may be a or b, all three need the same count.
+ATS_API void bitset_and(bitset* out, const bitset* a, const bitset* b);
+ATS_API void bitset_or(bitset* out, const bitset* a, const bitset* b);
+ATS_API void bitset_andnot(bitset* out, const bitset* a, const bitset* b); // a and not b
+ATS_API void bitset_xor(bitset* out, const bitset* a, const bitset* b);
+ATS_API u32 bitset_count(const bitset* set);
+ATS_API u32 bitset_next(const bitset* set, u32 from); // first set bit >= from, set->count if there is none
+
 #define STR_ITER_TABLE (256 >> 5)
 
 typedef struct {
@@ -581,6 +799,124 @@ ATS_API void str_iter_advance(str_iter* it);
        (var = macro_var(it).current, str_iter_is_valid(&macro_var(it))); \
        str_iter_advance(&macro_var(it)))
 
+// str_scan splits the same way as str_iter, but leaves the content untouched and yields views,
+// so it works on read only and not null terminated buffers. the tables are checked 32 bytes at
+// a time with AVX2 shuffles, 16 with SSE2 compares when a set has at most STR_SCAN_CHARS chars.
+//
+// Example:
+// str_scan(token, content, size, " \t\r\n", "{}=") {
+//   if (str_view_eq(token, "name")) ...
+// }
+
+#define STR_SCAN_CHARS (16)
+
+typedef struct {
+  const char* ptr;
+  usize len;
+} str_view;
+
+typedef struct {
+  u32 table[STR_ITER_TABLE];
+  u8 rows_lo[16];             // bit h of rows_lo[n] is byte h * 16 + n, h < 8
+  u8 rows_hi[16];             // same for h >= 8
+  u32 char_count;             // > STR_SCAN_CHARS if 'chars' doesn't hold the whole set
+  char chars[STR_SCAN_CHARS];
+} str__set;
+
+typedef struct {
+  str_view token;
+  const char* next;
+  const char* end;
+
+  u32 sep_table[STR_ITER_TABLE];
+
+  str__set skip;              // delimiters that aren't separators
+  str__set stop;              // delimiters and separators
+} str_scan;
+
+ATS_API str_scan str_scan_create(const char* content, usize size, const char* delimiters, const char* separators);
+ATS_API b32 str_scan_is_valid(str_scan* it);
+ATS_API void str_scan_advance(str_scan* it);
+ATS_API b32 str_view_eq(str_view view, const char* str);
+
+#define str_scan(var, ...) \
+  for (str_view var = { "", 0 }; var.ptr; var.ptr = 0) \
+  for (str_scan macro_var(it) = str_scan_create(__VA_ARGS__); \
+       (var = macro_var(it).token, str_scan_is_valid(&macro_var(it))); \
+       str_scan_advance(&macro_var(it)))
+
+// ============================================ HASH MAP ============================================= //
+// open addressing map from byte keys to a u64 value, with swiss table style control bytes that are
+// matched HASH_MAP_GROUP slots at a time. the full hash is stored per slot, so keys are only compared
+// when it matches. keys are copied into the map with a trailing 0, so string keys stay C strings.
+// zeroed is a valid heap backed map, set 'arena' before the first put to allocate from an arena instead (old storage is left in the arena on growth).
+//
+// Example:
+// hash_map map = {0};
+// *hash_map_put_str(&map, "player") = player_index;
+//
+// u64* value = hash_map_get_str(&map, "player");
+// if (value) ...
+//
+// hash_map_for(&map, i) {
+//   hash_map_slot* slot = &map.slots[i];
+// }
+
+#define HASH_MAP_GROUP   (16)
+#define HASH_MAP_EMPTY   (0x80)
+#define HASH_MAP_DELETED (0xfe)
+
+typedef struct {
+  u32 hash;
+  u32 key_size;
+  const void* key;   // stays at the same address until removed
+  u64 value;
+} hash_map_slot;
+
+typedef struct {
+  mem_arena* arena;     // null for heap backed maps
+  u32 count;
+  u32 deleted;
+  u32 cap;              // power of two, 0 until the first put
+  u8* ctrl;             // per slot: HASH_MAP_EMPTY, HASH_MAP_DELETED or 7 bits of the hash
+  hash_map_slot* slots;
+} hash_map;
+
+#define hash_map_for(map, index) \
+  for (u32 index = 0; index < (map)->cap; ++index) \
+    if ((map)->ctrl[index] < HASH_MAP_EMPTY)
+
+ATS_API u64* hash_map_get(hash_map* map, u32 hash, const void* key, u32 key_size); // null if missing
+ATS_API u64* hash_map_put(hash_map* map, u32 hash, const void* key, u32 key_size); // new values are 0. NOTE: may allocate memory
+ATS_API hash_map_slot* hash_map_put_slot(hash_map* map, u32 hash, const void* key, u32 key_size); // same, with the stored key
+ATS_API b32 hash_map_remove(hash_map* map, u32 hash, const void* key, u32 key_size);
+ATS_API void hash_map_clear(hash_map* map);
+ATS_API void hash_map_free(hash_map* map);
+
+ATS_API u64* hash_map_get_str(hash_map* map, const char* key);
+ATS_API u64* hash_map_put_str(hash_map* map, const char* key);
+ATS_API b32 hash_map_remove_str(hash_map* map, const char* key);
+
+// ============================================ INTERN ============================================== //
+// one global copy of every interned string. ids are dense, 1 up to str_intern_count(), and 0 is
+// never a valid id, so per string data can live in plain arrays indexed by id. intern names once at
+// load time and keep the ids, the lookups by id are array reads. not thread safe.
+//
+// Example:
+// u32 run = str_intern("run");              // at load time
+//
+// if (state->animation == run) ...          // per frame, no strcmp
+// const char* name = str_intern_get(run);
+
+ATS_API void str_intern_init(mem_arena* arena); // null keeps everything on the heap, the default. NOTE: only before the first str_intern
+ATS_API u32 str_intern(const char* str);
+ATS_API u32 str_intern_view(str_view view);
+ATS_API u32 str_intern_find(const char* str);   // 0 if 'str' was never interned, doesn't add it
+ATS_API u32 str_intern_count(void);
+ATS_API const char* str_intern_get(u32 id);
+ATS_API u32 str_intern_len(u32 id);
+ATS_API u32 str_intern_hash(u32 id);            // same as hash_str of the string
+
 typedef struct {
   v2 pos;
   v2 dir;
@@ -615,6 +951,24 @@ ATS_API void ray_iter_advance(ray_iter* it);
 ATS_API v2 ray_iter_get_position(ray_iter* it);
 ATS_API v2 ray_iter_get_normal(ray_iter* it);
 
+typedef struct {
+  b32 hit;
+  f32 dist; // perpendicular distance to the last side crossed, like ray_iter_get_position
+  i32 map_x;
+  i32 map_y;
+  i32 side;
+} ray_hit;
+
+// casts 'count' rays until each one hits a cell with its bit set in 'solid', leaves the map or goes
+// past max_dist, the start cell included. same steps as a ray_iter loop, with AVX2 8 rays are
+// stepped at once and a lane is refilled as soon as its ray is done.
+// Example:
+// ray_cast_batch(pos, dir, screen_width, walls, map_width, map_height, 64.0f, hits);
+// for (u32 x = 0; x < screen_width; ++x) {
+//   if (hits[x].hit) draw_column(x, hits[x].dist, hits[x].side);
+// }
+ATS_API void ray_cast_batch(const v2* pos, const v2* dir, u32 count, const u32* solid, i32 width, i32 height, f32 max_dist, ray_hit* out);
+
 typedef struct {
   v3 pos;
   v3 dir;
@@ -653,6 +1007,59 @@ ATS_API void ray3_iter_advance(ray3_iter* it);
 ATS_API v3 ray3_iter_get_position(ray3_iter* it);
 ATS_API v3 ray3_iter_get_normal(ray3_iter* it);
 
+// ========================================= VOXEL MAP ====================================== //
+// sparse solid voxels, stored as VOXEL_BRICK_SIZE^3 bricks of occupancy bits. only bricks with a
+// solid voxel are allocated and every VOXEL_REGION_SIZE^3 region counts its bricks, so
+// voxel_map_cast crosses empty regions and bricks in one step and only runs the ray3_iter dda
+// inside occupied bricks.
+//
+// Example:
+// voxel_map map = voxel_map_create(arena, 1024, 256, 1024);
+// voxel_map_set(&map, v3i(10, 2, 30), 1);
+//
+// ray3_hit hit = voxel_map_cast(&map, pos, dir, 100.0f);
+// if (hit.hit) {
+//   v3 p = v3_add(pos, v3_scale(dir, hit.dist));
+// }
+
+#define VOXEL_BRICK_SIZE  (8)
+#define VOXEL_REGION_SIZE (64)
+
+typedef struct {
+  u64 bits[VOXEL_BRICK_SIZE]; // bit x + y * 8 of word z
+} voxel_brick;
+
+typedef struct {
+  mem_arena* arena;
+  v3i size;           // in voxels
+  v3i bricks;         // brick grid size
+  v3i regions;        // region grid size
+  u32* brick_index;   // per brick, 1 + index into 'pool', 0 for empty bricks
+  u32* region_count;  // occupied bricks per region
+
+  u32 pool_len;
+  u32 pool_cap;
+  u32 free;           // 1 + first free brick, 0 if none
+  voxel_brick* pool;
+  u32* pool_solid;    // solid voxels per brick, the next free brick once freed
+} voxel_map;
+
+typedef struct {
+  b32 hit;
+  f32 dist; // along dir to the side crossed into the hit voxel, 0 if the ray starts inside it
+  i32 map_x;
+  i32 map_y;
+  i32 map_z;
+  i32 side; // same as ray3_iter
+} ray3_hit;
+
+ATS_API voxel_map voxel_map_create(mem_arena* arena, i32 size_x, i32 size_y, i32 size_z);
+ATS_API void voxel_map_clear(voxel_map* map);
+ATS_API void voxel_map_set(voxel_map* map, v3i cell, b32 solid); // NOTE: may allocate memory
+ATS_API b32 voxel_map_get(voxel_map* map, v3i cell); // false outside the map
+// walks the ray through the map until the first solid voxel, past max_dist or out of the map.
+ATS_API ray3_hit voxel_map_cast(voxel_map* map, v3 pos, v3 dir, f32 max_dist);
+
 #define path_node(...) (path_node) { __VA_ARGS__ }
 typedef struct {
   f32 w;
@@ -672,6 +1079,152 @@ ATS_API void path_queue_clear(path_queue* queue);
 ATS_API void path_queue_push(path_queue* queue, path_node node);
 ATS_API path_node path_queue_pop(path_queue* queue);
 
+// A* / jump point search over a passability bitmap, bit (x + y * width) set for walkable cells.
+// the records and the open heap are allocated once by path_grid_create, records are stamped with the
+// search generation so nothing is cleared or allocated per search.
+// NOTE: the bitmap is read in place, so changes to it show up in the next search.
+
+#define PATH_FLAG_DIAGONAL (1 << 0) // 8 directions, diagonal steps can't cut corners
+#define PATH_FLAG_JPS      (1 << 1) // jump point search, implies PATH_FLAG_DIAGONAL
+
+#define PATH_CLOSED (0xffffffffu)
+
+typedef struct {
+  u32 generation;
+  u32 parent;     // cell index, the start is its own parent
+  u32 heap_index; // slot in the open heap, PATH_CLOSED once expanded
+  f32 g;
+  f32 f;
+} path_record;
+
+typedef struct {
+  i32 width;
+  i32 height;
+  const u32* passable;
+
+  u32 generation;
+  u32 heap_count;
+  u32* heap;
+  path_record* records;
+} path_grid;
+
+ATS_API path_grid path_grid_create(mem_arena* arena, i32 width, i32 height, const u32* passable);
+// returns the number of cells on the path including start and goal, 0 if there is none.
+// writes the first min(count, out_max) cells to out.
+ATS_API u32 path_find(path_grid* grid, v2i start, v2i goal, u32 flags, v2i* out, u32 out_max);
+ATS_API f32 path_cost(path_grid* grid, v2i goal); // cost of the last found path, -1 if it didn't reach goal
+
+// distance / direction field towards the closest of a set of goals, for many units sharing them.
+// the grid is split in FLOW_TILE_SIZE tiles that are solved with dijkstra on their own and pass
+// changes on to their neighbors until nothing changes. passes can be spread across threads:
+//
+// while (flow_field_begin_pass(&field)) {
+//   // flow_field_run(&field, i) for every i < field.pass_count, on any threads
+//   flow_field_end_pass(&field);
+// }
+//
+// flow_field_build does the same on the calling thread. same bitmap and movement rules as path_find.
+// NOTE: after changing cells in the bitmap call flow_field_update with them and build again,
+// a goal cell that was blocked needs flow_field_set_goals to become a goal again.
+
+#ifndef FLOW_TILE_SIZE
+#define FLOW_TILE_SIZE (32)
+#endif
+
+#define FLOW_UNREACHABLE (1e30f)
+#define FLOW_DIR_NONE    (8)
+
+typedef struct {
+  i32 width;
+  i32 height;
+  const u32* passable;
+
+  i32 tiles_x;
+  i32 tiles_y;
+
+  f32* cost;        // distance to the closest goal, FLOW_UNREACHABLE if there is no way
+  u8* dir;          // 0..7 step towards the goal, counter clockwise from +x, FLOW_DIR_NONE for goals
+  u8* tile_dirty;
+  u8* tile_changed; // neighbor tiles the last pass has to wake up, one bit per direction
+
+  u32 color;
+  u32 pass_count;
+  u32* pass;        // tiles of the current pass
+} flow_field;
+
+ATS_API flow_field flow_field_create(mem_arena* arena, i32 width, i32 height, const u32* passable);
+ATS_API void flow_field_set_goals(flow_field* field, const v2i* goals, u32 goal_count);
+ATS_API void flow_field_update(flow_field* field, const v2i* cells, u32 cell_count);
+ATS_API u32 flow_field_begin_pass(flow_field* field); // returns the number of tiles to run, 0 once done
+ATS_API void flow_field_run(flow_field* field, u32 pass_index);
+ATS_API void flow_field_end_pass(flow_field* field);
+ATS_API void flow_field_build(flow_field* field);
+ATS_API v2 flow_field_dir(flow_field* field, v2i cell); // unit direction, zero at goals and unreachable cells
+ATS_API f32 flow_field_cost(flow_field* field, v2i cell);
+
+// hierarchical pathfinding for big maps: the grid is cut in HPA_CLUSTER_SIZE clusters, the
+// entrances between clusters and the distances between entrances of one cluster are cached
+// and searched instead of the cells. same bitmap and movement rules as path_find.
+// hpa_find returns waypoints, turn the part a unit is about to walk into cells with hpa_refine.
+// paths are close to optimal, not always optimal.
+// NOTE: call hpa_update with the cells that changed in the bitmap, only their clusters and the
+// neighbors sharing a border are rebuilt on the next search.
+// NOTE: when the costs outgrow their storage the old one is left in the arena.
+
+#ifndef HPA_CLUSTER_SIZE
+#define HPA_CLUSTER_SIZE (32) // at most 256
+#endif
+
+#ifndef HPA_LONG_ENTRANCE
+#define HPA_LONG_ENTRANCE (6) // entrances at least this long get a node at each end, at least 3
+#endif
+
+// a border fits at most one entrance per two cells, so every entrance gets a node.
+#define HPA_BORDER_NODES ((HPA_CLUSTER_SIZE + 1) / 2)
+
+#define HPA_CLUSTER_NODES (4 * HPA_BORDER_NODES)
+
+typedef struct {
+  u8 border_count[4];           // entrances on the +x, +y, -x, -y border
+  u8 offset[HPA_CLUSTER_NODES]; // position along the border, slot = border * HPA_BORDER_NODES + i
+  u32 cost_count;               // entrances the costs are laid out for
+  u32 cost_offset;              // into hpa_map.costs, cost_count * cost_count costs between entrances inside the cluster
+} hpa_cluster;
+
+typedef struct {
+  u32 generation;
+  u32 parent;
+  b32 closed;
+  f32 g;
+} hpa_record;
+
+typedef struct {
+  i32 width;
+  i32 height;
+  const u32* passable;
+
+  i32 clusters_x;
+  i32 clusters_y;
+  hpa_cluster* clusters;
+
+  mem_arena* arena;
+  f32* costs;          // every cluster's costs back to back, in cluster order
+  u32 cost_cap;
+
+  u8* dirty;
+  u32 dirty_count;
+
+  u32 generation;
+  hpa_record* records; // one per entrance slot, then start and goal
+} hpa_map;
+
+ATS_API hpa_map hpa_create(mem_arena* arena, i32 width, i32 height, const u32* passable);
+ATS_API void hpa_update(hpa_map* hpa, const v2i* cells, u32 cell_count);
+// returns the number of waypoints from start to goal, 0 if there is no path. writes the first min(count, out_max).
+ATS_API u32 hpa_find(hpa_map* hpa, v2i start, v2i goal, v2i* out, u32 out_max);
+// cells from one waypoint to the next, both included.
+ATS_API u32 hpa_refine(hpa_map* hpa, v2i from, v2i to, v2i* out, u32 out_max);
+
 #define SPATIAL_TABLE_MAX 4096
 #define SPATIAL_TABLE_MOD 4095
 
@@ -680,19 +1233,199 @@ struct sm_node {
   sm_node* next;
   void* e;
   r2 rect;
+  i32 x; // the cell this node was added to
+  i32 y;
 };
 
+#ifndef SPATIAL_KNN_TILE
+#define SPATIAL_KNN_TILE (16)           // cells per side of the tiles sm_knn_batch groups queries in
+#endif
+
+#ifndef SPATIAL_KNN_BATCH_CELLS
+#define SPATIAL_KNN_BATCH_CELLS (4096)  // most cells one sm_knn_batch tile may gather
+#endif
+
+#ifndef SPATIAL_LOAD_FACTOR
+#define SPATIAL_LOAD_FACTOR (2) // max nodes per bucket on average before the table doubles
+#endif
+
+// a zeroed spatial_map is valid: 1 unit cells, a fixed SPATIAL_TABLE_MAX table and nodes from the
+// top of the arena stack. sm_init gives it an arena for nodes, a cell size and a table that doubles
+// once there are more than SPATIAL_LOAD_FACTOR nodes per bucket, sm_clear then recycles its nodes.
+// NOTE: when the table grows the old one is left in the arena.
+// NOTE: a copied map shares its nodes with the original, only one of them should be modified.
 typedef struct {
-  sm_node* table[SPATIAL_TABLE_MAX];
+  mem_arena* arena;
+
+  f32 cell_size;
+  f32 inv_cell_size;
+
+  u32 table_mod;
+  u32 count;
+  sm_node** table; // null while 'inline_table' is used
+  sm_node* free;
+
+  sm_node* inline_table[SPATIAL_TABLE_MAX];
 } spatial_map;
 
+ATS_API void sm_init(spatial_map* map, mem_arena* arena, f32 cell_size);
 ATS_API void sm_clear(spatial_map* map);
+ATS_API void sm_remove(spatial_map* map, void* e, r2 e_rect);                // e_rect must be the rect e was added / moved with
+ATS_API void sm_move(spatial_map* map, void* e, r2 old_rect, r2 new_rect); // NOTE: may allocate memory
 ATS_API u32 sm_index(spatial_map* map, i32 x, i32 y);
 ATS_API sm_node* sm_get(spatial_map* map, i32 x, i32 y);
 ATS_API void sm_add(spatial_map* map, void* e, r2 e_rect); // NOTE: allocates memory
 ATS_API void* sm_get_closest(spatial_map* map, v2 pos, f32 range, void* ignore, b32 (*condition_proc)(void*));
 ATS_API void* sm_at_position(spatial_map* map, v2 pos);
 ATS_API sm_node* sm_in_range(spatial_map* map, v2 pos, v2 rad, void* ignore); // NOTE: allocates memory
+ATS_API u32 sm_query(spatial_map* map, v2 pos, v2 rad, void* ignore, void** out, u32 out_max); // returns the number of entities written to out
+
+typedef struct {
+  void* e;
+  f32 dist_sq; // to the center of the entity rect
+} sm_neighbor;
+
+// writes up to k nearest entities within range to out, closest first, and returns how many.
+// NOTE: range has to be finite, cells are searched ring by ring until range or the k-th hit rules out the rest.
+ATS_API u32 sm_knn(spatial_map* map, v2 pos, f32 range, u32 k, void* ignore, sm_neighbor* out);
+// answers 'count' queries at once, meant for agents that are close to each other. queries are grouped
+// in tiles of SPATIAL_KNN_TILE cells that gather their candidates once, a range that reaches past
+// SPATIAL_KNN_BATCH_CELLS cells per tile answers every query with sm_knn instead.
+// out holds k neighbors per query (out + i * k), out_count the number found for each. ignore may be null.
+ATS_API void sm_knn_batch(spatial_map* map, const v2* pos, void** ignore, u32 count, f32 range, u32 k, sm_neighbor* out, u32* out_count);
+
+// 3d version of spatial_map, keyed by hash3i. same rules: zeroed is valid, sm3_init for an arena and growth.
+
+typedef struct sm3_node sm3_node;
+struct sm3_node {
+  sm3_node* next;
+  void* e;
+  r3 rect;
+  i32 x; // the cell this node was added to
+  i32 y;
+  i32 z;
+};
+
+typedef struct {
+  mem_arena* arena;
+
+  f32 cell_size;
+  f32 inv_cell_size;
+
+  u32 table_mod;
+  u32 count;
+  sm3_node** table; // null while 'inline_table' is used
+  sm3_node* free;
+
+  sm3_node* inline_table[SPATIAL_TABLE_MAX];
+} spatial_map3;
+
+ATS_API void sm3_init(spatial_map3* map, mem_arena* arena, f32 cell_size);
+ATS_API void sm3_clear(spatial_map3* map);
+ATS_API void sm3_remove(spatial_map3* map, void* e, r3 e_rect);
+ATS_API void sm3_move(spatial_map3* map, void* e, r3 old_rect, r3 new_rect); // NOTE: may allocate memory
+ATS_API u32 sm3_index(spatial_map3* map, i32 x, i32 y, i32 z);
+ATS_API sm3_node* sm3_get(spatial_map3* map, i32 x, i32 y, i32 z);
+ATS_API void sm3_add(spatial_map3* map, void* e, r3 e_rect); // NOTE: allocates memory
+ATS_API void* sm3_get_closest(spatial_map3* map, v3 pos, f32 range, void* ignore, b32 (*condition_proc)(void*));
+ATS_API void* sm3_at_position(spatial_map3* map, v3 pos);
+ATS_API sm3_node* sm3_in_range(spatial_map3* map, v3 pos, v3 rad, void* ignore); // NOTE: allocates memory
+ATS_API u32 sm3_query(spatial_map3* map, v3 pos, v3 rad, void* ignore, void** out, u32 out_max);
+ATS_API u32 sm3_knn(spatial_map3* map, v3 pos, f32 range, u32 k, void* ignore, sm_neighbor* out);
+
+// cell sorted grid, meant to be rebuilt every frame: sg_clear, sg_add everything, sg_build, then query.
+// sg_build counting sorts the entries by cell so queries scan contiguous memory.
+// NOTE: queries stamp entries to skip duplicates, so don't query one grid from several threads.
+
+typedef struct {
+  void* e;
+  r2 rect;
+} sg_item;
+
+typedef struct {
+  u32 index;
+  r2 rect;
+} sg_entry;
+
+typedef struct {
+  mem_arena* arena;
+
+  f32 cell_size;
+  f32 inv_cell_size;
+  u32 table_mod;
+  u32 stamp;
+
+  u32 item_count;
+  u32 item_cap;
+  sg_item* items;
+  u32* stamps;
+
+  u32 entry_count;
+  u32 entry_cap;
+  sg_entry* entries;
+  u32* cell_start; // table_mod + 2 offsets into entries
+} spatial_grid;
+
+ATS_API spatial_grid sg_create(mem_arena* arena, u32 table_log2, f32 cell_size);
+ATS_API void sg_clear(spatial_grid* grid);
+ATS_API void sg_add(spatial_grid* grid, void* e, r2 e_rect); // NOTE: may allocate memory
+ATS_API void sg_build(spatial_grid* grid);                   // NOTE: may allocate memory
+ATS_API u32 sg_in_range(spatial_grid* grid, v2 pos, v2 rad, void* ignore, void** out, u32 out_max);
+ATS_API void* sg_get_closest(spatial_grid* grid, v2 pos, f32 range, void* ignore, b32 (*condition_proc)(void*));
+ATS_API void* sg_at_position(spatial_grid* grid, v2 pos);
+
+// dynamic aabb tree, for entities of very different sizes that a grid would register in lots of cells.
+// leaves keep a box fattened by 'margin', bvh_move only touches the tree once an entity leaves it.
+// 2d users pass their rects through bvh_r2.
+// NOTE: ids are stable until removed, node storage doubles and the old nodes are left in the arena.
+
+#ifndef BVH_STACK_SIZE
+#define BVH_STACK_SIZE (128) // traversal stack, the tree is kept balanced so this is plenty
+#endif
+
+#define BVH_NULL (0xffffffffu)
+
+#define bvh_r2(rect) r3({ (rect).min.x, (rect).min.y, 0 }, { (rect).max.x, (rect).max.y, 0 })
+
+typedef struct {
+  r3 box;     // fattened bounds for leaves, union of the children otherwise
+  r3 rect;    // the bounds the leaf was inserted / moved with
+  void* e;
+  u32 parent; // next free node for free nodes
+  u32 left;
+  u32 right;
+  i32 height; // 0 for leaves, -1 for free nodes
+} bvh_node;
+
+typedef struct {
+  mem_arena* arena;
+  f32 margin;
+
+  u32 root;
+  u32 count;
+  u32 free;
+
+  u32 node_count;
+  u32 node_cap;
+  bvh_node* nodes;
+} bvh_tree;
+
+typedef struct {
+  void* a;
+  void* b;
+} bvh_pair;
+
+ATS_API bvh_tree bvh_create(mem_arena* arena, f32 margin);
+ATS_API void bvh_clear(bvh_tree* tree);
+ATS_API u32 bvh_insert(bvh_tree* tree, void* e, r3 box);   // NOTE: may allocate memory
+ATS_API void bvh_remove(bvh_tree* tree, u32 id);
+ATS_API b32 bvh_move(bvh_tree* tree, u32 id, r3 box);      // returns 1 if the leaf had to be reinserted
+ATS_API void* bvh_get(bvh_tree* tree, u32 id);
+ATS_API u32 bvh_query_box(bvh_tree* tree, r3 box, void* ignore, void** out, u32 out_max);
+ATS_API u32 bvh_query_point(bvh_tree* tree, v3 pos, void** out, u32 out_max);
+ATS_API u32 bvh_query_ray(bvh_tree* tree, v3 pos, v3 dir, f32 max_t, void** out, u32 out_max); // dir doesn't need to be normalized, t is in units of dir
+ATS_API void* bvh_raycast(bvh_tree* tree, v3 pos, v3 dir, f32 max_t, void* ignore, f32* t_out); // closest hit
+ATS_API u32 bvh_query_pairs(bvh_tree* tree, bvh_pair* out, u32 out_max); // every overlapping pair once
 
 // ================================================================================================== //
 // ---------------------------------------------- ROUTINE ------------------------------------------- //
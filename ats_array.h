@@ -1,47 +1,80 @@
 #pragma once
 
-#include "ats_base.h"
+#include "ats.h"
 
-#include <stdlib.h>
-
-#define DYN_INIT_SIZE (256)
+#ifndef DYN_INIT_SIZE
+#define DYN_INIT_SIZE (16)
+#endif
 
 typedef struct
 {
-  u32 cap;
-  u32 len;
+  usize cap;
+  usize len;
+  mem_arena* arena; // null for heap allocated arrays
   u8 buf[];
 } dyn_hdr_t;
 
 #define dyn(type_t) type_t*
 
+// NOTE: arena backed arrays grow in place while they are the last allocation in the arena.
+#define dyn_make(xs, arena, cap)  ((xs) = dyn__make(sizeof (xs)[0], (cap), (arena)))
+
 #define dyn_hdr(xs)             ((dyn_hdr_t*)(xs) - 1)
 #define dyn_cap(xs)             ((xs)? dyn_hdr(xs)->cap : 0)
 #define dyn_len(xs)             ((xs)? dyn_hdr(xs)->len : 0)
-#define dyn_add(xs, ...)        ((xs) = dyn__grow((xs), sizeof (xs)[0]), (xs)[dyn_hdr(xs)->len++] = (__VA_ARGS__))
-#define dyn_new(xs)             ((xs) = dyn__grow((xs), sizeof (xs)[0]), memset(&(xs)[dyn_hdr(xs)->len++], 0, sizeof *(xs)))
+#define dyn_add(xs, ...)        ((xs) = dyn__grow((xs), sizeof (xs)[0], 1), (xs)[dyn_hdr(xs)->len++] = (__VA_ARGS__))
+#define dyn_add_n(xs, n)        ((xs) = dyn__grow((xs), sizeof (xs)[0], (n)), dyn_hdr(xs)->len += (n), (xs) + dyn_hdr(xs)->len - (n))
+#define dyn_reserve(xs, n)      ((xs) = dyn__grow((xs), sizeof (xs)[0], (n) > dyn_len(xs)? (n) - dyn_len(xs) : 0))
+#define dyn_new(xs)             ((xs) = dyn__grow((xs), sizeof (xs)[0], 1), memset(&(xs)[dyn_hdr(xs)->len++], 0, sizeof *(xs)))
 #define dyn_rem(xs, i)          ((xs)[(i)] = (xs)[--dyn_hdr(xs)->len])
-#define dyn_del(xs)             (free(xs))
+#define dyn_del(xs)             ((xs) && !dyn_hdr(xs)->arena? free(dyn_hdr(xs)) : (void)0)
 #define dyn_sort(xs, cmp_func)  (qsort((xs), dyn_len(xs), sizeof (xs)[0], cmp_func))
 
-static void* dyn__grow(void* xs, u32 element_size)
+static void* dyn__make(usize element_size, usize cap, mem_arena* arena)
+{
+  usize size = sizeof (dyn_hdr_t) + element_size * cap;
+  dyn_hdr_t* hdr = arena?
+    mem_alloc(size, 0, arena, .flags = MEM_ALLOC_NO_HEADER | MEM_ALLOC_NO_ZERO) :
+    malloc(size);
+  hdr->len = 0;
+  hdr->cap = cap;
+  hdr->arena = arena;
+  return hdr->buf;
+}
+
+static void* dyn__grow(void* xs, usize element_size, usize count)
 {
-  dyn_hdr_t* hdr = 0;
-  u32 len = 0;
-  u32 cap = 0;
-  if (xs)
+  if (!xs)
   {
-    hdr = dyn_hdr(xs);
-    len = hdr->len;
-    cap = hdr->cap;
+    return dyn__make(element_size, max(count, (usize)DYN_INIT_SIZE), 0);
   }
-  if (len >= cap)
+
+  dyn_hdr_t* hdr = dyn_hdr(xs);
+  if (hdr->len + count <= hdr->cap)
+  {
+    return xs;
+  }
+
+  usize cap = max(hdr->cap << 1, hdr->len + count);
+  mem_arena* arena = hdr->arena;
+
+  if (!arena)
   {
-    cap = (cap << 1) + (!cap) * DYN_INIT_SIZE;
     hdr = realloc(hdr, sizeof (dyn_hdr_t) + element_size * cap);
+    hdr->cap = cap;
+    return hdr->buf;
   }
-  hdr->len = len;
-  hdr->cap = cap;
-  return hdr->buf;
-}
 
+  u8* end = hdr->buf + element_size * hdr->cap;
+  if (end == arena->buf + arena->pos)
+  {
+    mem_end(element_size * (cap - hdr->cap), arena);
+    hdr->cap = cap;
+    return hdr->buf;
+  }
+
+  u8* buf = dyn__make(element_size, cap, arena);
+  memcpy(buf, hdr->buf, element_size * hdr->len);
+  dyn_hdr(buf)->len = hdr->len;
+  return buf;
+}
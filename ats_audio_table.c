@@ -18,10 +18,6 @@ typedef struct {
 #pragma clang diagnostic pop
 #endif
 
-#ifndef AUDIO_TABLE_SIZE
-#define AUDIO_TABLE_SIZE (256)
-#endif
-
 #ifndef AUDIO_PATH
 #define AUDIO_PATH "assets/sounds/"
 #endif
@@ -29,12 +25,14 @@ typedef struct {
 static const char* audio_path = AUDIO_PATH;
 
 struct audio_entry {
-  b32 in_use;
   cs_audio_source_t* source;
-  char name[64];
 };
 
-static struct audio_entry audio_table[AUDIO_TABLE_SIZE];
+static hash_map audio_table; // name -> index into audio_entries
+
+static u32 audio_count;
+static u32 audio_cap;
+static struct audio_entry* audio_entries;
 
 static void audio_init(void* handle) {
   cs_init(handle, 44100, 2 * 1024, NULL);
@@ -47,21 +45,23 @@ static b32 audio_is_valid(audio_id id) {
 }
 
 static audio_id audio_get(const char* name) {
-  u32 hash = hash_str(name);
-  u16 index = hash & (AUDIO_TABLE_SIZE - 1);
+  u64* value = hash_map_put_str(&audio_table, name);
 
-  if (index == 0) index++;
+  if (*value) {
+    audio_id id = { (u16)*value };
+    return id;
+  }
 
-  while (audio_table[index].in_use) {
-    if (strcmp(audio_table[index].name, name) == 0) {
-      audio_id id = { index };
-      return id;
-    }
+  assert(audio_count < 0xffff);
 
-    index = (index + 1) & (AUDIO_TABLE_SIZE - 1);
-    if (index == 0) index++;
+  if (audio_count == audio_cap) {
+    audio_cap = max(audio_cap << 1, 64);
+    audio_entries = realloc(audio_entries, audio_cap * sizeof (struct audio_entry));
   }
 
+  // ids are index + 1, 0 stays invalid.
+  *value = ++audio_count;
+
   char path[512] = {0};
 
   {
@@ -75,10 +75,7 @@ static audio_id audio_get(const char* name) {
     path[i++] = '\0';
   }
 
-  struct audio_entry* entry = &audio_table[index];
-
-  entry->in_use = true;
-  strcpy_s(entry->name, countof(entry->name), name);
+  struct audio_entry* entry = &audio_entries[audio_count - 1];
 
   cs_error_t error = CUTE_SOUND_ERROR_NONE;
   entry->source = cs_load_wav(path, &error);
@@ -87,7 +84,7 @@ static audio_id audio_get(const char* name) {
     printf("%s ---- path: %s\n", cs_error_as_string(error), path);
   }
 
-  audio_id id = { index };
+  audio_id id = { (u16)audio_count };
   return id;
 }
 
@@ -100,10 +97,10 @@ static void audio_kill_all(void) {
 }
 
 static struct audio_entry* audio_get_entry(audio_id id) {
-  if (!id.index || id.index > AUDIO_TABLE_SIZE)
+  if (!id.index || id.index > audio_count)
     return NULL;
 
-  return audio_table[id.index].in_use? &audio_table[id.index] : NULL;
+  return &audio_entries[id.index - 1];
 }
 
 static void audio_play(audio_id id, f32 volume) {
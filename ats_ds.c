@@ -1,23 +1,200 @@
 #include "ats.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 // ====================================== BIT STUFF =================================== //
 
 ATS_API void bit_set(u32* array, u32 index) {
   u32 idx = index >> 5;
   u32 bit = index & 31;
-  array[idx] |= (1 << bit);
+  array[idx] |= (1u << bit);
 }
 
 ATS_API b32 bit_get(u32* array, u32 index) {
   u32 idx = index >> 5;
   u32 bit = index & 31;
-  return array[idx] & (1 << bit);
+  return (array[idx] >> bit) & 1;
 }
 
 ATS_API void bit_clr(u32* array, u32 index) {
   u32 idx = index >> 5;
   u32 bit = index & 31;
-  array[idx] &= ~(1 << bit);
+  array[idx] &= ~(1u << bit);
+}
+
+// index of the lowest set bit, n must not be 0.
+static u32 bit__ctz(u32 n) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, n);
+  return (u32)index;
+#else
+  return (u32)__builtin_ctz(n);
+#endif
+}
+
+static u32 bit__ctz64(u64 n) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, n);
+  return (u32)index;
+#else
+  return (u32)__builtin_ctzll(n);
+#endif
+}
+
+static u32 bit__popcount64(u64 n) {
+#if defined(_MSC_VER)
+  return (u32)__popcnt64(n);
+#elif defined(__POPCNT__)
+  return (u32)__builtin_popcountll(n);
+#else
+  // without the popcnt instruction the builtin is a library call, this is faster.
+  n = n - ((n >> 1) & 0x5555555555555555ull);
+  n = (n & 0x3333333333333333ull) + ((n >> 2) & 0x3333333333333333ull);
+  n = (n + (n >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return (u32)((n * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// ============================================= BITSET ============================================= //
+
+ATS_API bitset bitset_create(mem_arena* arena, u32 count) {
+  bitset set = {0};
+  set.count = count;
+  set.word_count = align_up((count + 63) >> 6, BITSET_BLOCK);
+  set.words = mem_array(u64, set.word_count, arena);
+  return set;
+}
+
+ATS_API void bitset_set(bitset* set, u32 index) {
+  assert(index < set->count);
+  set->words[index >> 6] |= 1ull << (index & 63);
+}
+
+ATS_API b32 bitset_get(const bitset* set, u32 index) {
+  assert(index < set->count);
+  return (set->words[index >> 6] >> (index & 63)) & 1;
+}
+
+ATS_API void bitset_clr(bitset* set, u32 index) {
+  assert(index < set->count);
+  set->words[index >> 6] &= ~(1ull << (index & 63));
+}
+
+ATS_API void bitset_fill(bitset* set, u32 begin, u32 end) {
+  assert(end <= set->count);
+  if (begin >= end) return;
+
+  u32 first = begin >> 6;
+  u32 last = (end - 1) >> 6;
+  u64 first_mask = ~0ull << (begin & 63);
+  u64 last_mask = ~0ull >> (63 - ((end - 1) & 63));
+
+  if (first == last) {
+    set->words[first] |= first_mask & last_mask;
+    return;
+  }
+
+  set->words[first] |= first_mask;
+  memset(set->words + first + 1, 0xff, (last - first - 1) * sizeof (u64));
+  set->words[last] |= last_mask;
+}
+
+ATS_API void bitset_clear(bitset* set, u32 begin, u32 end) {
+  assert(end <= set->count);
+  if (begin >= end) return;
+
+  u32 first = begin >> 6;
+  u32 last = (end - 1) >> 6;
+  u64 first_mask = ~0ull << (begin & 63);
+  u64 last_mask = ~0ull >> (63 - ((end - 1) & 63));
+
+  if (first == last) {
+    set->words[first] &= ~(first_mask & last_mask);
+    return;
+  }
+
+  set->words[first] &= ~first_mask;
+  memset(set->words + first + 1, 0, (last - first - 1) * sizeof (u64));
+  set->words[last] &= ~last_mask;
+}
+
+#ifdef __AVX2__
+#define BITSET__SIMD(simd_op) \
+  for (u32 i = 0; i < out->word_count; i += BITSET_BLOCK) { \
+    __m256i va = _mm256_loadu_si256((const __m256i*)(a->words + i)); \
+    __m256i vb = _mm256_loadu_si256((const __m256i*)(b->words + i)); \
+    _mm256_storeu_si256((__m256i*)(out->words + i), simd_op); \
+  }
+#else
+#define BITSET__SIMD(simd_op) \
+  for (u32 i = 0; i < out->word_count; ++i) { \
+    u64 va = a->words[i]; \
+    u64 vb = b->words[i]; \
+    out->words[i] = simd_op; \
+  }
+#endif
+
+#ifdef __AVX2__
+#define BITSET__AND     _mm256_and_si256(va, vb)
+#define BITSET__OR      _mm256_or_si256(va, vb)
+#define BITSET__ANDNOT  _mm256_andnot_si256(vb, va)
+#define BITSET__XOR     _mm256_xor_si256(va, vb)
+#else
+#define BITSET__AND     (va & vb)
+#define BITSET__OR      (va | vb)
+#define BITSET__ANDNOT  (va & ~vb)
+#define BITSET__XOR     (va ^ vb)
+#endif
+
+ATS_API void bitset_and(bitset* out, const bitset* a, const bitset* b) {
+  assert(out->count == a->count && out->count == b->count);
+  BITSET__SIMD(BITSET__AND)
+}
+
+ATS_API void bitset_or(bitset* out, const bitset* a, const bitset* b) {
+  assert(out->count == a->count && out->count == b->count);
+  BITSET__SIMD(BITSET__OR)
+}
+
+ATS_API void bitset_andnot(bitset* out, const bitset* a, const bitset* b) {
+  assert(out->count == a->count && out->count == b->count);
+  BITSET__SIMD(BITSET__ANDNOT)
+}
+
+ATS_API void bitset_xor(bitset* out, const bitset* a, const bitset* b) {
+  assert(out->count == a->count && out->count == b->count);
+  BITSET__SIMD(BITSET__XOR)
+}
+
+ATS_API u32 bitset_count(const bitset* set) {
+  u32 count = 0;
+  for (u32 i = 0; i < set->word_count; ++i) {
+    count += bit__popcount64(set->words[i]);
+  }
+  return count;
+}
+
+ATS_API u32 bitset_next(const bitset* set, u32 from) {
+  if (from >= set->count) return set->count;
+
+  u32 i = from >> 6;
+  u64 word = set->words[i] & (~0ull << (from & 63));
+
+  for (;;) {
+    if (word) return (i << 6) + bit__ctz64(word);
+    if (++i == set->word_count) return set->count;
+    word = set->words[i];
+  }
 }
 
 // ========================================== S8 ====================================== //
@@ -33,7 +210,7 @@ ATS_API void str_iter_advance(str_iter* it) {
     it->end = 0;
   }
 
-  while (*it->current && bit_get(it->del_table, it->current[0]) && !bit_get(it->sep_table, it->current[0])) {
+  while (*it->current && bit_get(it->del_table, (u8)it->current[0]) && !bit_get(it->sep_table, (u8)it->current[0])) {
     it->current++;
   }
 
@@ -43,8 +220,8 @@ ATS_API void str_iter_advance(str_iter* it) {
   }
 
   it->end = it->current + 1;
-  if (!bit_get(it->sep_table, it->current[0])) {
-    while (*it->end && !bit_get(it->del_table, it->end[0]) && !bit_get(it->sep_table, it->end[0])) {
+  if (!bit_get(it->sep_table, (u8)it->current[0])) {
+    while (*it->end && !bit_get(it->del_table, (u8)it->end[0]) && !bit_get(it->sep_table, (u8)it->end[0])) {
       it->end++;
     }
   }
@@ -61,17 +238,444 @@ ATS_API str_iter str_iter_create(char* content, const char* delimiters, const ch
   if (!separators) separators = "";
 
   for (u32 i = 0; delimiters[i]; ++i) {
-    bit_set(it.del_table, delimiters[i]);
+    bit_set(it.del_table, (u8)delimiters[i]);
   }
 
   for (u32 i = 0; separators[i]; ++i) {
-    bit_set(it.sep_table, separators[i]);
+    bit_set(it.sep_table, (u8)separators[i]);
   }
 
   str_iter_advance(&it);
   return it;
 }
 
+static void str__set_build(str__set* set) {
+  set->char_count = 0;
+
+  for (u32 c = 0; c < 256; ++c) {
+    if (!((set->table[c >> 5] >> (c & 31)) & 1)) continue;
+
+    if (c < 128) set->rows_lo[c & 15] |= 1 << (c >> 4);
+    else         set->rows_hi[c & 15] |= 1 << ((c >> 4) - 8);
+
+    if (set->char_count < STR_SCAN_CHARS) set->chars[set->char_count] = (char)c;
+    set->char_count++;
+  }
+}
+
+static b32 str__in_set(const str__set* set, char c) {
+  u8 b = (u8)c;
+  return (set->table[b >> 5] >> (b & 31)) & 1;
+}
+
+// first byte in [p, end) that is in the set, or isn't when 'member' is false.
+static const char* str__find(const str__set* set, const char* p, const char* end, b32 member) {
+#if defined(__AVX2__)
+  __m256i rows_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)set->rows_lo));
+  __m256i rows_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)set->rows_hi));
+  __m256i bits = _mm256_setr_epi8(
+    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+    1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+  __m256i nibble = _mm256_set1_epi8(15);
+  __m256i seven = _mm256_set1_epi8(7);
+  u32 flip = member? 0 : ~0u;
+
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    __m256i lo = _mm256_and_si256(v, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+
+    // the low nibble picks the row, the high nibble the bit in it.
+    __m256i row = _mm256_blendv_epi8(
+      _mm256_shuffle_epi8(rows_lo, lo),
+      _mm256_shuffle_epi8(rows_hi, lo),
+      _mm256_cmpgt_epi8(hi, seven));
+    __m256i bit = _mm256_shuffle_epi8(bits, hi);
+    __m256i in = _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+
+    u32 mask = (u32)_mm256_movemask_epi8(in) ^ flip;
+    if (mask) return p + bit__ctz(mask);
+    p += 32;
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  // no byte shuffle in SSE2, small sets compare against every char instead.
+  if (set->char_count <= STR_SCAN_CHARS) {
+    u32 flip = member? 0 : 0xffff;
+
+    while (end - p >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)p);
+      __m128i in = _mm_setzero_si128();
+
+      for (u32 i = 0; i < set->char_count; ++i) {
+        in = _mm_or_si128(in, _mm_cmpeq_epi8(v, _mm_set1_epi8(set->chars[i])));
+      }
+
+      u32 mask = (u32)_mm_movemask_epi8(in) ^ flip;
+      if (mask) return p + bit__ctz(mask);
+      p += 16;
+    }
+  }
+#endif
+
+  while (p < end && str__in_set(set, *p) != member) {
+    p++;
+  }
+
+  return p;
+}
+
+ATS_API b32 str_scan_is_valid(str_scan* it) {
+  return it->token.ptr != 0;
+}
+
+ATS_API void str_scan_advance(str_scan* it) {
+  const char* start = str__find(&it->skip, it->next, it->end, 0);
+
+  if (start == it->end) {
+    it->token.ptr = 0;
+    it->token.len = 0;
+    it->next = it->end;
+    return;
+  }
+
+  // separators are tokens of their own.
+  const char* stop = start + 1;
+  if (!bit_get(it->sep_table, (u8)start[0])) {
+    stop = str__find(&it->stop, stop, it->end, 1);
+  }
+
+  it->token.ptr = start;
+  it->token.len = (usize)(stop - start);
+  it->next = stop;
+}
+
+ATS_API str_scan str_scan_create(const char* content, usize size, const char* delimiters, const char* separators) {
+  str_scan it = {0};
+  it.next = content;
+  it.end = content + size;
+
+  if (!delimiters) delimiters = "";
+  if (!separators) separators = "";
+
+  u32 del_table[STR_ITER_TABLE] = {0};
+
+  for (u32 i = 0; delimiters[i]; ++i) {
+    bit_set(del_table, (u8)delimiters[i]);
+  }
+
+  for (u32 i = 0; separators[i]; ++i) {
+    bit_set(it.sep_table, (u8)separators[i]);
+  }
+
+  for (u32 i = 0; i < STR_ITER_TABLE; ++i) {
+    it.skip.table[i] = del_table[i] & ~it.sep_table[i];
+    it.stop.table[i] = del_table[i] | it.sep_table[i];
+  }
+
+  str__set_build(&it.skip);
+  str__set_build(&it.stop);
+
+  str_scan_advance(&it);
+  return it;
+}
+
+ATS_API b32 str_view_eq(str_view view, const char* str) {
+  usize len = strlen(str);
+  return view.len == len && memcmp(view.ptr, str, len) == 0;
+}
+
+// ============================================ HASH MAP ============================================ //
+
+// spreads the caller's hash, hash_str and friends leave the high bits poor for short keys.
+static u32 hash_map__mix(u32 hash) {
+  return hashu(hash);
+}
+
+// bit i set for every control byte in the group equal to 'value'.
+static u32 hash_map__match(const u8* group, u8 value) {
+#if defined(__SSE2__) || defined(_M_X64)
+  __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+  return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+  u32 mask = 0;
+  for (u32 i = 0; i < HASH_MAP_GROUP; ++i) {
+    mask |= (u32)(group[i] == value) << i;
+  }
+  return mask;
+#endif
+}
+
+// bit i set for every empty or deleted slot, both have the high bit set.
+static u32 hash_map__match_free(const u8* group) {
+#if defined(__SSE2__) || defined(_M_X64)
+  return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+  u32 mask = 0;
+  for (u32 i = 0; i < HASH_MAP_GROUP; ++i) {
+    mask |= (u32)(group[i] >> 7) << i;
+  }
+  return mask;
+#endif
+}
+
+static void* hash_map__alloc(hash_map* map, usize size) {
+  return map->arena? mem_alloc(size, 0, map->arena, .flags = MEM_ALLOC_NO_ZERO) : malloc(size);
+}
+
+static void hash_map__release(hash_map* map, const void* ptr) {
+  if (!map->arena) free((void*)ptr);
+}
+
+static u32 hash_map__find(hash_map* map, u32 hash, const void* key, u32 key_size) {
+  if (!map->cap) return map->cap;
+
+  u32 mixed = hash_map__mix(hash);
+  u8 h2 = (u8)(mixed >> 25);
+  u32 mask = map->cap - 1;
+  u32 pos = mixed & mask & ~(HASH_MAP_GROUP - 1);
+
+  // triangular steps over the groups, this visits every group once the count of groups is a power of two.
+  for (u32 step = HASH_MAP_GROUP;; step += HASH_MAP_GROUP) {
+    const u8* group = map->ctrl + pos;
+
+    for (u32 match = hash_map__match(group, h2); match; match &= match - 1) {
+      hash_map_slot* slot = &map->slots[pos + bit__ctz(match)];
+      if (slot->hash == hash && slot->key_size == key_size && memcmp(slot->key, key, key_size) == 0) {
+        return pos + bit__ctz(match);
+      }
+    }
+
+    if (hash_map__match(group, HASH_MAP_EMPTY)) return map->cap;
+    pos = (pos + step) & mask;
+  }
+}
+
+static u32 hash_map__find_free(hash_map* map, u32 mixed) {
+  u32 mask = map->cap - 1;
+  u32 pos = mixed & mask & ~(HASH_MAP_GROUP - 1);
+
+  for (u32 step = HASH_MAP_GROUP;; step += HASH_MAP_GROUP) {
+    u32 open = hash_map__match_free(map->ctrl + pos);
+    if (open) return pos + bit__ctz(open);
+    pos = (pos + step) & mask;
+  }
+}
+
+static void hash_map__rehash(hash_map* map, u32 cap) {
+  u8* old_ctrl = map->ctrl;
+  hash_map_slot* old_slots = map->slots;
+  u32 old_cap = map->cap;
+
+  map->cap = cap;
+  map->deleted = 0;
+  map->ctrl = hash_map__alloc(map, cap);
+  map->slots = hash_map__alloc(map, cap * sizeof (hash_map_slot));
+  memset(map->ctrl, HASH_MAP_EMPTY, cap);
+
+  for (u32 i = 0; i < old_cap; ++i) {
+    if (old_ctrl[i] >= HASH_MAP_EMPTY) continue;
+
+    u32 index = hash_map__find_free(map, hash_map__mix(old_slots[i].hash));
+    map->ctrl[index] = old_ctrl[i];
+    map->slots[index] = old_slots[i];
+  }
+
+  hash_map__release(map, old_ctrl);
+  hash_map__release(map, old_slots);
+}
+
+ATS_API u64* hash_map_get(hash_map* map, u32 hash, const void* key, u32 key_size) {
+  u32 index = hash_map__find(map, hash, key, key_size);
+  return index < map->cap? &map->slots[index].value : 0;
+}
+
+ATS_API hash_map_slot* hash_map_put_slot(hash_map* map, u32 hash, const void* key, u32 key_size) {
+  u32 index = hash_map__find(map, hash, key, key_size);
+  if (index < map->cap) return &map->slots[index];
+
+  // grow past 7/8 full, tombstones alone only need a rehash at the same size.
+  if (8 * (map->count + map->deleted + 1) > 7 * map->cap) {
+    u32 cap = max(map->cap, 2 * HASH_MAP_GROUP);
+    if (8 * (map->count + 1) > 3 * cap) cap <<= 1;
+    hash_map__rehash(map, cap);
+  }
+
+  u32 mixed = hash_map__mix(hash);
+  index = hash_map__find_free(map, mixed);
+
+  if (map->ctrl[index] == HASH_MAP_DELETED) map->deleted--;
+  map->count++;
+
+  char* key_copy = hash_map__alloc(map, key_size + 1);
+  if (key_size) memcpy(key_copy, key, key_size);
+  key_copy[key_size] = '\0';
+
+  hash_map_slot* slot = &map->slots[index];
+  slot->hash = hash;
+  slot->key_size = key_size;
+  slot->key = key_copy;
+  slot->value = 0;
+
+  map->ctrl[index] = (u8)(mixed >> 25);
+  return slot;
+}
+
+ATS_API u64* hash_map_put(hash_map* map, u32 hash, const void* key, u32 key_size) {
+  return &hash_map_put_slot(map, hash, key, key_size)->value;
+}
+
+ATS_API b32 hash_map_remove(hash_map* map, u32 hash, const void* key, u32 key_size) {
+  u32 index = hash_map__find(map, hash, key, key_size);
+  if (index == map->cap) return 0;
+
+  // a group that still has an empty slot never made a probe go on past it, so the slot can be empty again.
+  const u8* group = map->ctrl + (index & ~(HASH_MAP_GROUP - 1));
+  if (hash_map__match(group, HASH_MAP_EMPTY)) {
+    map->ctrl[index] = HASH_MAP_EMPTY;
+  } else {
+    map->ctrl[index] = HASH_MAP_DELETED;
+    map->deleted++;
+  }
+
+  hash_map__release(map, map->slots[index].key);
+  map->count--;
+  return 1;
+}
+
+ATS_API void hash_map_clear(hash_map* map) {
+  hash_map_for(map, i) {
+    hash_map__release(map, map->slots[i].key);
+  }
+
+  if (map->cap) memset(map->ctrl, HASH_MAP_EMPTY, map->cap);
+  map->count = 0;
+  map->deleted = 0;
+}
+
+ATS_API void hash_map_free(hash_map* map) {
+  hash_map_clear(map);
+  hash_map__release(map, map->ctrl);
+  hash_map__release(map, map->slots);
+
+  mem_arena* arena = map->arena;
+  memset(map, 0, sizeof *map);
+  map->arena = arena;
+}
+
+ATS_API u64* hash_map_get_str(hash_map* map, const char* key) {
+  return hash_map_get(map, hash_str(key), key, (u32)strlen(key));
+}
+
+ATS_API u64* hash_map_put_str(hash_map* map, const char* key) {
+  return hash_map_put(map, hash_str(key), key, (u32)strlen(key));
+}
+
+ATS_API b32 hash_map_remove_str(hash_map* map, const char* key) {
+  return hash_map_remove(map, hash_str(key), key, (u32)strlen(key));
+}
+
+// ============================================= INTERN ============================================= //
+
+typedef struct {
+  const char* str;
+  u32 len;
+  u32 hash;
+} str__interned;
+
+static struct {
+  hash_map map;         // string -> id
+  u32 count;
+  u32 cap;
+  str__interned* array; // by id, 0 unused
+} str__intern;
+
+ATS_API void str_intern_init(mem_arena* arena) {
+  // ids are kept around, by timer_scope call sites and the timer table among others.
+  assert(!str__intern.count && "str_intern_init after strings were interned");
+
+  if (!str__intern.map.arena) {
+    hash_map_free(&str__intern.map);
+    free(str__intern.array);
+  }
+
+  memset(&str__intern, 0, sizeof str__intern);
+  str__intern.map.arena = arena;
+}
+
+// hash_str for strings that aren't null terminated.
+static u32 str__hash_n(const char* str, usize len) {
+  u32 hash = 5381;
+  for (usize i = 0; i < len; i++) {
+    hash = ((hash << 5) + hash) + str[i];
+  }
+  return hash;
+}
+
+static u32 str__intern_n(const char* str, usize len) {
+  u32 hash = str__hash_n(str, len);
+  hash_map_slot* slot = hash_map_put_slot(&str__intern.map, hash, str, (u32)len);
+
+  if (slot->value) return (u32)slot->value;
+
+  if (str__intern.count + 1 >= str__intern.cap) {
+    u32 cap = max(str__intern.cap << 1, 256);
+    mem_arena* arena = str__intern.map.arena;
+
+    if (arena) {
+      str__interned* array = mem_array(str__interned, cap, arena, .flags = MEM_ALLOC_NO_ZERO);
+      if (str__intern.cap) memcpy(array, str__intern.array, str__intern.cap * sizeof (str__interned));
+      str__intern.array = array;
+    } else {
+      str__intern.array = realloc(str__intern.array, cap * sizeof (str__interned));
+    }
+
+    str__intern.cap = cap;
+  }
+
+  u32 id = ++str__intern.count;
+
+  // the map's copy of the key is the one stored string.
+  str__interned* interned = &str__intern.array[id];
+  interned->str = slot->key;
+  interned->len = (u32)len;
+  interned->hash = hash;
+
+  slot->value = id;
+  return id;
+}
+
+ATS_API u32 str_intern(const char* str) {
+  return str__intern_n(str, strlen(str));
+}
+
+ATS_API u32 str_intern_view(str_view view) {
+  return str__intern_n(view.ptr, view.len);
+}
+
+ATS_API u32 str_intern_find(const char* str) {
+  u64* value = hash_map_get_str(&str__intern.map, str);
+  return value? (u32)*value : 0;
+}
+
+ATS_API u32 str_intern_count(void) {
+  return str__intern.count;
+}
+
+ATS_API const char* str_intern_get(u32 id) {
+  assert(id && id <= str__intern.count);
+  return str__intern.array[id].str;
+}
+
+ATS_API u32 str_intern_len(u32 id) {
+  assert(id && id <= str__intern.count);
+  return str__intern.array[id].len;
+}
+
+ATS_API u32 str_intern_hash(u32 id) {
+  assert(id && id <= str__intern.count);
+  return str__intern.array[id].hash;
+}
+
 // =========================================== RAY ITER 2D ========================================== //
 
 ATS_API ray_iter ray_iter_create(v2 pos, v2 dir) {
@@ -119,6 +723,7 @@ ATS_API ray_iter ray_iter_create(v2 pos, v2 dir) {
 }
 
 ATS_API b32 ray_iter_is_valid(ray_iter* it) {
+  (void)it;
   return 1;
 }
 
@@ -151,6 +756,175 @@ ATS_API v2 ray_iter_get_normal(ray_iter* it) {
   return (v2) {0};
 }
 
+// ========================================== RAY CAST BATCH ========================================= //
+
+static void ray__hit(ray_hit* hit, ray_iter* it, f32 dist, b32 solid) {
+  hit->hit = solid;
+  hit->dist = dist;
+  hit->map_x = it->map_x;
+  hit->map_y = it->map_y;
+  hit->side = it->side;
+}
+
+#ifdef __AVX2__
+
+// lane state of ray_cast_batch, the loop keeps it in registers and only comes back here to refill lanes.
+typedef struct {
+  f32 side_dist_x[8];
+  f32 side_dist_y[8];
+  f32 delta_dist_x[8];
+  f32 delta_dist_y[8];
+  i32 index[8];      // map_x + map_y * width
+  i32 step_x[8];
+  i32 step_y[8];     // step_y * width
+  i32 left_x[8];     // steps until the ray leaves the map, negative once it did
+  i32 left_y[8];
+  i32 side[8];       // -1 after a y step
+  i32 live[8];       // -1 while the lane has a ray
+
+  // map_x, map_y of a finished lane are worked out from its start and the steps it took.
+  ray_iter start[8];
+  i32 start_left_x[8];
+  i32 start_left_y[8];
+  u32 ray[8];
+} ray__lanes;
+
+static void ray__set_lane(ray__lanes* l, u32 lane, u32 ray, v2 pos, v2 dir, i32 width, i32 height) {
+  ray_iter it = ray_iter_create(pos, dir);
+  b32 inside = (u32)it.map_x < (u32)width && (u32)it.map_y < (u32)height;
+
+  l->side_dist_x[lane] = it.side_dist_x;
+  l->side_dist_y[lane] = it.side_dist_y;
+  l->delta_dist_x[lane] = it.delta_dist_x;
+  l->delta_dist_y[lane] = it.delta_dist_y;
+  l->index[lane] = it.map_x + it.map_y * width;
+  l->step_x[lane] = it.step_x;
+  l->step_y[lane] = it.step_y * width;
+  l->left_x[lane] = !inside? -1 : it.step_x > 0? width - 1 - it.map_x : it.map_x;
+  l->left_y[lane] = !inside? -1 : it.step_y > 0? height - 1 - it.map_y : it.map_y;
+  l->side[lane] = 0;
+  l->live[lane] = -1;
+  l->start[lane] = it;
+  l->start_left_x[lane] = l->left_x[lane];
+  l->start_left_y[lane] = l->left_y[lane];
+  l->ray[lane] = ray;
+}
+
+ATS_API void ray_cast_batch(const v2* pos, const v2* dir, u32 count, const u32* solid, i32 width, i32 height, f32 max_dist, ray_hit* out) {
+  ray__lanes l = {0};
+  u32 next = 0;
+  u32 live_count = 0;
+
+  for (u32 i = 0; i < 8; ++i) {
+    l.left_x[i] = -1;
+    if (next < count) {
+      ray__set_lane(&l, i, next, pos[next], dir[next], width, height);
+      next++;
+      live_count++;
+    }
+  }
+
+  __m256 max = _mm256_set1_ps(max_dist);
+  __m256i zero = _mm256_setzero_si256();
+  __m256i all = _mm256_set1_epi32(-1);
+
+  while (live_count) {
+    __m256 side_dist_x = _mm256_loadu_ps(l.side_dist_x);
+    __m256 side_dist_y = _mm256_loadu_ps(l.side_dist_y);
+    __m256 delta_dist_x = _mm256_loadu_ps(l.delta_dist_x);
+    __m256 delta_dist_y = _mm256_loadu_ps(l.delta_dist_y);
+    __m256i index = _mm256_loadu_si256((const __m256i*)l.index);
+    __m256i step_x = _mm256_loadu_si256((const __m256i*)l.step_x);
+    __m256i step_y = _mm256_loadu_si256((const __m256i*)l.step_y);
+    __m256i left_x = _mm256_loadu_si256((const __m256i*)l.left_x);
+    __m256i left_y = _mm256_loadu_si256((const __m256i*)l.left_y);
+    __m256i side = _mm256_loadu_si256((const __m256i*)l.side);
+    __m256i live = _mm256_loadu_si256((const __m256i*)l.live);
+
+    for (;;) {
+      // the current cell is tested before every step, the start cell included.
+      __m256 dist = _mm256_blendv_ps(_mm256_sub_ps(side_dist_x, delta_dist_x), _mm256_sub_ps(side_dist_y, delta_dist_y), _mm256_castsi256_ps(side));
+      __m256i far = _mm256_castps_si256(_mm256_cmp_ps(dist, max, _CMP_GT_OQ));
+      __m256i outside = _mm256_or_si256(_mm256_srai_epi32(_mm256_or_si256(left_x, left_y), 31), far);
+      __m256i test = _mm256_andnot_si256(outside, live);
+
+      __m256i word = _mm256_mask_i32gather_epi32(zero, (const int*)solid, _mm256_srli_epi32(index, 5), test, 4);
+      __m256i bit = _mm256_and_si256(_mm256_srlv_epi32(word, _mm256_and_si256(index, _mm256_set1_epi32(31))), _mm256_set1_epi32(1));
+      __m256i done = _mm256_and_si256(_mm256_or_si256(outside, _mm256_sub_epi32(zero, bit)), live);
+
+      u32 done_bits = (u32)_mm256_movemask_ps(_mm256_castsi256_ps(done));
+      if (done_bits) {
+        _mm256_storeu_ps(l.side_dist_x, side_dist_x);
+        _mm256_storeu_ps(l.side_dist_y, side_dist_y);
+        _mm256_storeu_si256((__m256i*)l.index, index);
+        _mm256_storeu_si256((__m256i*)l.left_x, left_x);
+        _mm256_storeu_si256((__m256i*)l.left_y, left_y);
+        _mm256_storeu_si256((__m256i*)l.side, side);
+
+        f32 lane_dist[8];
+        i32 lane_outside[8];
+        _mm256_storeu_ps(lane_dist, dist);
+        _mm256_storeu_si256((__m256i*)lane_outside, outside);
+
+        // finished lanes are refilled right away, so one long ray doesn't hold up the others.
+        while (done_bits) {
+          u32 i = bit__ctz(done_bits);
+          done_bits &= done_bits - 1;
+
+          ray_iter* it = &l.start[i];
+          it->map_x += it->step_x * (l.start_left_x[i] - l.left_x[i]);
+          it->map_y += it->step_y * (l.start_left_y[i] - l.left_y[i]);
+          it->side = l.side[i] & 1;
+          ray__hit(&out[l.ray[i]], it, lane_dist[i], !lane_outside[i]);
+
+          if (next < count) {
+            ray__set_lane(&l, i, next, pos[next], dir[next], width, height);
+            next++;
+          } else {
+            l.live[i] = 0;
+            live_count--;
+          }
+        }
+        break;
+      }
+
+      __m256i take_x = _mm256_castps_si256(_mm256_cmp_ps(side_dist_x, side_dist_y, _CMP_LT_OQ));
+      __m256i take_y = _mm256_xor_si256(take_x, all);
+
+      side_dist_x = _mm256_add_ps(side_dist_x, _mm256_and_ps(delta_dist_x, _mm256_castsi256_ps(take_x)));
+      side_dist_y = _mm256_add_ps(side_dist_y, _mm256_and_ps(delta_dist_y, _mm256_castsi256_ps(take_y)));
+      index = _mm256_add_epi32(index, _mm256_blendv_epi8(step_y, step_x, take_x));
+      left_x = _mm256_add_epi32(left_x, take_x);
+      left_y = _mm256_add_epi32(left_y, take_y);
+      side = take_y;
+    }
+  }
+}
+
+#else
+
+// no gather before AVX2, 4 lanes with scalar bitmap reads aren't faster than one ray at a time.
+ATS_API void ray_cast_batch(const v2* pos, const v2* dir, u32 count, const u32* solid, i32 width, i32 height, f32 max_dist, ray_hit* out) {
+  for (u32 i = 0; i < count; ++i) {
+    ray_iter(it, pos[i], dir[i]) {
+      f32 dist = it.side == 0? it.side_dist_x - it.delta_dist_x : it.side_dist_y - it.delta_dist_y;
+
+      if ((u32)it.map_x >= (u32)width || (u32)it.map_y >= (u32)height || dist > max_dist) {
+        ray__hit(&out[i], &it, dist, 0);
+        break;
+      }
+
+      u32 index = (u32)(it.map_x + it.map_y * width);
+      if ((solid[index >> 5] >> (index & 31)) & 1) {
+        ray__hit(&out[i], &it, dist, 1);
+        break;
+      }
+    }
+  }
+}
+
+#endif
+
 // =========================================== RAY ITER 3D ========================================== //
 
 ATS_API ray3_iter ray3_iter_create(v3 pos, v3 dir) {
@@ -200,6 +974,7 @@ ATS_API ray3_iter ray3_iter_create(v3 pos, v3 dir) {
 }
 
 ATS_API b32 ray3_iter_is_valid(ray3_iter* it) {
+  (void)it;
   return 1;
 }
 
@@ -235,37 +1010,348 @@ ATS_API v3 ray3_iter_get_normal(ray3_iter* it) {
   return (v3) {0};
 }
 
-// ========================================= PRIORITY QUEUE ====================================== //
+// ============================================ VOXEL MAP =========================================== //
 
-ATS_API path_queue path_queue_create(usize capacity) {
-  path_queue queue = {0};
-  queue.len = 0;
-  queue.buf = mem_array(path_node, capacity);
-  return queue;
+ATS_API voxel_map voxel_map_create(mem_arena* arena, i32 size_x, i32 size_y, i32 size_z) {
+  voxel_map map = {0};
+
+  map.arena = arena;
+  map.size = v3i(size_x, size_y, size_z);
+  map.bricks = v3i(
+    (size_x + VOXEL_BRICK_SIZE - 1) / VOXEL_BRICK_SIZE,
+    (size_y + VOXEL_BRICK_SIZE - 1) / VOXEL_BRICK_SIZE,
+    (size_z + VOXEL_BRICK_SIZE - 1) / VOXEL_BRICK_SIZE);
+  map.regions = v3i(
+    (size_x + VOXEL_REGION_SIZE - 1) / VOXEL_REGION_SIZE,
+    (size_y + VOXEL_REGION_SIZE - 1) / VOXEL_REGION_SIZE,
+    (size_z + VOXEL_REGION_SIZE - 1) / VOXEL_REGION_SIZE);
+
+  map.brick_index = mem_array(u32, (usize)map.bricks.x * map.bricks.y * map.bricks.z, arena);
+  map.region_count = mem_array(u32, (usize)map.regions.x * map.regions.y * map.regions.z, arena);
+
+  return map;
 }
 
-ATS_API b32 path_queue_empty(path_queue* queue) {
-  return queue->len == 0;
+ATS_API void voxel_map_clear(voxel_map* map) {
+  memset(map->brick_index, 0, (usize)map->bricks.x * map->bricks.y * map->bricks.z * sizeof (u32));
+  memset(map->region_count, 0, (usize)map->regions.x * map->regions.y * map->regions.z * sizeof (u32));
+  map->pool_len = 0;
+  map->free = 0;
 }
 
-ATS_API void path_queue_clear(path_queue* queue) {
-  queue->len = 0;
+static usize voxel__brick_of(voxel_map* map, i32 x, i32 y, i32 z) {
+  x /= VOXEL_BRICK_SIZE;
+  y /= VOXEL_BRICK_SIZE;
+  z /= VOXEL_BRICK_SIZE;
+  return (usize)x + (usize)map->bricks.x * (y + (usize)map->bricks.y * z);
 }
 
-ATS_API void path_queue_push(path_queue* queue, path_node node) {
-  u32 i = queue->len + 1;
-  u32 j = i / 2;
-  while (i > 1 && queue->buf[j].w > node.w) {
-    queue->buf[i] = queue->buf[j];
-    i = j;
-    j = j / 2;
+static usize voxel__region_of(voxel_map* map, i32 x, i32 y, i32 z) {
+  x /= VOXEL_REGION_SIZE;
+  y /= VOXEL_REGION_SIZE;
+  z /= VOXEL_REGION_SIZE;
+  return (usize)x + (usize)map->regions.x * (y + (usize)map->regions.y * z);
+}
+
+static u32 voxel__alloc_brick(voxel_map* map) {
+  u32 id = map->free;
+
+  if (id) {
+    map->free = map->pool_solid[id - 1];
+  } else {
+    if (map->pool_len == map->pool_cap) {
+      u32 cap = max(map->pool_cap << 1, 64);
+      voxel_brick* pool = mem_array(voxel_brick, cap, map->arena, .flags = MEM_ALLOC_NO_ZERO);
+      u32* pool_solid = mem_array(u32, cap, map->arena, .flags = MEM_ALLOC_NO_ZERO);
+      if (map->pool_len) {
+        memcpy(pool, map->pool, map->pool_len * sizeof (voxel_brick));
+        memcpy(pool_solid, map->pool_solid, map->pool_len * sizeof (u32));
+      }
+      map->pool = pool;
+      map->pool_solid = pool_solid;
+      map->pool_cap = cap;
+    }
+    id = ++map->pool_len;
   }
-  queue->buf[i] = node;
-  queue->len++;
+
+  memset(&map->pool[id - 1], 0, sizeof (voxel_brick));
+  map->pool_solid[id - 1] = 0;
+  return id;
 }
 
-ATS_API path_node path_queue_pop(path_queue* queue) {
-  path_node node = queue->buf[1];
+ATS_API void voxel_map_set(voxel_map* map, v3i cell, b32 solid) {
+  assert((u32)cell.x < (u32)map->size.x && (u32)cell.y < (u32)map->size.y && (u32)cell.z < (u32)map->size.z);
+
+  usize brick_index = voxel__brick_of(map, cell.x, cell.y, cell.z);
+  usize region_index = voxel__region_of(map, cell.x, cell.y, cell.z);
+  u32 id = map->brick_index[brick_index];
+
+  if (!id) {
+    if (!solid) return;
+    id = voxel__alloc_brick(map);
+    map->brick_index[brick_index] = id;
+    map->region_count[region_index]++;
+  }
+
+  u64* word = &map->pool[id - 1].bits[cell.z & (VOXEL_BRICK_SIZE - 1)];
+  u64 bit = 1ull << ((cell.x & (VOXEL_BRICK_SIZE - 1)) + (cell.y & (VOXEL_BRICK_SIZE - 1)) * VOXEL_BRICK_SIZE);
+
+  if (solid == ((*word & bit) != 0)) return;
+
+  if (solid) {
+    *word |= bit;
+    map->pool_solid[id - 1]++;
+    return;
+  }
+
+  *word &= ~bit;
+
+  // the last solid voxel is gone, the brick goes back to the free list.
+  if (--map->pool_solid[id - 1] == 0) {
+    map->brick_index[brick_index] = 0;
+    map->region_count[region_index]--;
+    map->pool_solid[id - 1] = map->free;
+    map->free = id;
+  }
+}
+
+static b32 voxel__brick_get(voxel_brick* brick, i32 x, i32 y, i32 z) {
+  x &= VOXEL_BRICK_SIZE - 1;
+  y &= VOXEL_BRICK_SIZE - 1;
+  z &= VOXEL_BRICK_SIZE - 1;
+  return (brick->bits[z] >> (x + y * VOXEL_BRICK_SIZE)) & 1;
+}
+
+ATS_API b32 voxel_map_get(voxel_map* map, v3i cell) {
+  if ((u32)cell.x >= (u32)map->size.x || (u32)cell.y >= (u32)map->size.y || (u32)cell.z >= (u32)map->size.z) return 0;
+
+  u32 id = map->brick_index[voxel__brick_of(map, cell.x, cell.y, cell.z)];
+  return id && voxel__brick_get(&map->pool[id - 1], cell.x, cell.y, cell.z);
+}
+
+// points the dda at a new cell, side dists are measured from the ray origin like ray3_iter_create.
+static void voxel__iter_at(ray3_iter* it, const f32* inv, i32 x, i32 y, i32 z) {
+  it->map_x = x;
+  it->map_y = y;
+  it->map_z = z;
+  it->side_dist_x = inv[0] == 0? 1e30f : ((x + (it->step_x > 0)) - it->pos.x) * inv[0];
+  it->side_dist_y = inv[1] == 0? 1e30f : ((y + (it->step_y > 0)) - it->pos.y) * inv[1];
+  it->side_dist_z = inv[2] == 0? 1e30f : ((z + (it->step_z > 0)) - it->pos.z) * inv[2];
+}
+
+static f32 voxel__iter_dist(ray3_iter* it) {
+  if      (it->side == 0) return it->side_dist_x - it->delta_dist_x;
+  else if (it->side == 1) return it->side_dist_y - it->delta_dist_y;
+  else                    return it->side_dist_z - it->delta_dist_z;
+}
+
+// one bit per 4^3 octant of the brick that has a solid voxel, bit x + y * 2 + z * 4.
+static u32 voxel__brick_octants(voxel_brick* brick) {
+  u64 lo = brick->bits[0] | brick->bits[1] | brick->bits[2] | brick->bits[3];
+  u64 hi = brick->bits[4] | brick->bits[5] | brick->bits[6] | brick->bits[7];
+  u64 quarter = 0x0f0f0f0full;
+  u32 octants = 0;
+
+  octants |= ((lo & quarter) != 0) << 0;
+  octants |= ((lo & (quarter << 4)) != 0) << 1;
+  octants |= ((lo & (quarter << 32)) != 0) << 2;
+  octants |= ((lo & (quarter << 36)) != 0) << 3;
+  octants |= ((hi & quarter) != 0) << 4;
+  octants |= ((hi & (quarter << 4)) != 0) << 5;
+  octants |= ((hi & (quarter << 32)) != 0) << 6;
+  octants |= ((hi & (quarter << 36)) != 0) << 7;
+
+  return octants;
+}
+
+static u32 voxel__octant_of(ray3_iter* it) {
+  return ((it->map_x >> 2) & 1) | (((it->map_y >> 2) & 1) << 1) | (((it->map_z >> 2) & 1) << 2);
+}
+
+// shifts instead of divides, so a step out of the map below 0 still counts as a different brick.
+static b32 voxel__brick_changed(ray3_iter* it, i32 brick_x, i32 brick_y, i32 brick_z) {
+  return (it->map_x >> 3) != brick_x || (it->map_y >> 3) != brick_y || (it->map_z >> 3) != brick_z;
+}
+
+ATS_API ray3_hit voxel_map_cast(voxel_map* map, v3 pos, v3 dir, f32 max_dist) {
+  ray3_hit result = {0};
+
+  f32 inv[3] = {0};
+  f32 t = 0;
+  f32 t_exit = 1e30f; // where the ray leaves the map
+  i32 side = 0;
+
+  // clip the ray to the map bounds.
+  for (i32 axis = 0; axis < 3; ++axis) {
+    f32 size = (f32)map->size.e[axis];
+
+    if (dir.e[axis] == 0) {
+      if (pos.e[axis] < 0 || pos.e[axis] >= size) return result;
+      continue;
+    }
+
+    inv[axis] = 1.0f / dir.e[axis];
+
+    f32 t0 = (0 - pos.e[axis]) * inv[axis];
+    f32 t1 = (size - pos.e[axis]) * inv[axis];
+    if (t0 > t1) swap(f32, t0, t1);
+
+    if (t0 > t) {
+      t = t0;
+      side = axis;
+    }
+    t_exit = min(t_exit, t1);
+  }
+
+  if (t > t_exit || t > max_dist) return result;
+
+  ray3_iter it = {0};
+  it.pos = pos;
+  it.dir = dir;
+  it.step_x = dir.x < 0? -1 : 1;
+  it.step_y = dir.y < 0? -1 : 1;
+  it.step_z = dir.z < 0? -1 : 1;
+  it.delta_dist_x = inv[0] == 0? 1e30f : fabsf(inv[0]);
+  it.delta_dist_y = inv[1] == 0? 1e30f : fabsf(inv[1]);
+  it.delta_dist_z = inv[2] == 0? 1e30f : fabsf(inv[2]);
+  it.side = side;
+
+  i32 cell[3];
+  for (i32 axis = 0; axis < 3; ++axis) {
+    cell[axis] = clamp((i32)floorf(pos.e[axis] + dir.e[axis] * t), 0, map->size.e[axis] - 1);
+  }
+
+  // a ray that starts outside enters through the side it was clipped against.
+  if (t > 0) {
+    cell[side] = dir.e[side] > 0? 0 : map->size.e[side] - 1;
+  }
+
+  voxel__iter_at(&it, inv, cell[0], cell[1], cell[2]);
+
+  for (;;) {
+    if ((u32)it.map_x >= (u32)map->size.x || (u32)it.map_y >= (u32)map->size.y || (u32)it.map_z >= (u32)map->size.z) break;
+    if (t > max_dist) break;
+
+    i32 box_size = VOXEL_REGION_SIZE;
+
+    if (map->region_count[voxel__region_of(map, it.map_x, it.map_y, it.map_z)]) {
+      u32 id = map->brick_index[voxel__brick_of(map, it.map_x, it.map_y, it.map_z)];
+
+      if (id) {
+        // occupied brick, plain dda until the ray hits something, enters an empty octant or leaves the brick.
+        voxel_brick* brick = &map->pool[id - 1];
+        u32 octants = voxel__brick_octants(brick);
+        i32 brick_x = it.map_x >> 3;
+        i32 brick_y = it.map_y >> 3;
+        i32 brick_z = it.map_z >> 3;
+
+        box_size = 0;
+
+        for (;;) {
+          if (!(octants & (1u << voxel__octant_of(&it)))) {
+            box_size = VOXEL_BRICK_SIZE / 2;
+            break;
+          }
+
+          if (voxel__brick_get(brick, it.map_x, it.map_y, it.map_z)) {
+            result.hit = 1;
+            result.dist = t;
+            result.map_x = it.map_x;
+            result.map_y = it.map_y;
+            result.map_z = it.map_z;
+            result.side = it.side;
+            return result;
+          }
+
+          ray3_iter_advance(&it);
+          t = voxel__iter_dist(&it);
+
+          if (t > max_dist) return result;
+          if (voxel__brick_changed(&it, brick_x, brick_y, brick_z)) break;
+        }
+
+        if (!box_size) continue;
+      } else {
+        box_size = VOXEL_BRICK_SIZE;
+      }
+    }
+
+    // empty region, brick or octant, jump to the side the ray leaves it through.
+    i32 lo[3] = {
+      it.map_x & ~(box_size - 1),
+      it.map_y & ~(box_size - 1),
+      it.map_z & ~(box_size - 1),
+    };
+    i32 step[3] = { it.step_x, it.step_y, it.step_z };
+    i32 current[3] = { it.map_x, it.map_y, it.map_z };
+
+    f32 t_next = 1e30f;
+    i32 axis_next = 0;
+    for (i32 axis = 0; axis < 3; ++axis) {
+      if (inv[axis] == 0) continue;
+      f32 plane = (f32)(step[axis] > 0? lo[axis] + box_size : lo[axis]);
+      f32 t_axis = (plane - pos.e[axis]) * inv[axis];
+      if (t_axis < t_next) {
+        t_next = t_axis;
+        axis_next = axis;
+      }
+    }
+
+    t = max(t, t_next);
+    it.side = axis_next;
+
+    // the cells below are clamped to the map, a ray that leaves it from this box has to stop here.
+    if (t >= t_exit) break;
+
+    for (i32 axis = 0; axis < 3; ++axis) {
+      if (axis == axis_next) {
+        cell[axis] = step[axis] > 0? lo[axis] + box_size : lo[axis] - 1;
+      } else {
+        // the other axes stay inside the box and the map and never go back against the ray,
+        // rounding would skip or revisit a cell otherwise.
+        i32 first = step[axis] > 0? current[axis] : max(lo[axis], 0);
+        i32 last = step[axis] > 0? min(lo[axis] + box_size, map->size.e[axis]) - 1 : current[axis];
+        cell[axis] = clamp((i32)floorf(pos.e[axis] + dir.e[axis] * t), first, last);
+      }
+    }
+
+    voxel__iter_at(&it, inv, cell[0], cell[1], cell[2]);
+  }
+
+  return result;
+}
+
+// ========================================= PRIORITY QUEUE ====================================== //
+
+ATS_API path_queue path_queue_create(usize capacity) {
+  path_queue queue = {0};
+  queue.len = 0;
+  queue.buf = mem_array(path_node, capacity, .flags = MEM_ALLOC_NO_ZERO);
+  return queue;
+}
+
+ATS_API b32 path_queue_empty(path_queue* queue) {
+  return queue->len == 0;
+}
+
+ATS_API void path_queue_clear(path_queue* queue) {
+  queue->len = 0;
+}
+
+ATS_API void path_queue_push(path_queue* queue, path_node node) {
+  u32 i = queue->len + 1;
+  u32 j = i / 2;
+  while (i > 1 && queue->buf[j].w > node.w) {
+    queue->buf[i] = queue->buf[j];
+    i = j;
+    j = j / 2;
+  }
+  queue->buf[i] = node;
+  queue->len++;
+}
+
+ATS_API path_node path_queue_pop(path_queue* queue) {
+  path_node node = queue->buf[1];
   queue->buf[1] = queue->buf[queue->len];
   queue->len--;
   u32 i = 1;
@@ -284,107 +1370,2600 @@ ATS_API path_node path_queue_pop(path_queue* queue) {
   return node;
 }
 
-// =================================================== SPATIAL MAP =================================================== //
+// ========================================== GRID PATHFINDING ========================================== //
 
-ATS_API void sm_clear(spatial_map* map) {
-  for (u32 i = 0; i < SPATIAL_TABLE_MAX; ++i) {
-    map->table[i] = 0;
+#define PATH_SQRT2 (1.41421356f)
+
+ATS_API path_grid path_grid_create(mem_arena* arena, i32 width, i32 height, const u32* passable) {
+  path_grid grid = {0};
+  usize cell_count = (usize)width * height;
+
+  grid.width = width;
+  grid.height = height;
+  grid.passable = passable;
+  grid.records = mem_array(path_record, cell_count, arena);
+  grid.heap = mem_array(u32, cell_count, arena, .flags = MEM_ALLOC_NO_ZERO);
+
+  return grid;
+}
+
+static b32 path__open(path_grid* grid, i32 x, i32 y) {
+  if ((u32)x >= (u32)grid->width || (u32)y >= (u32)grid->height) return 0;
+  u32 index = (u32)(x + y * grid->width);
+  return (grid->passable[index >> 5] >> (index & 31)) & 1;
+}
+
+static f32 path__heuristic(i32 dx, i32 dy, b32 diagonal) {
+  dx = dx < 0? -dx : dx;
+  dy = dy < 0? -dy : dy;
+  if (!diagonal) return (f32)(dx + dy);
+  return (f32)max(dx, dy) + (PATH_SQRT2 - 1.0f) * (f32)min(dx, dy);
+}
+
+// ---------------- indexed min heap on f, records know their slot for decrease key ---------------- //
+
+static b32 path__less(path_grid* grid, u32 a, u32 b) {
+  path_record* ra = &grid->records[a];
+  path_record* rb = &grid->records[b];
+  // equal f prefers the deeper node, it is closer to the goal.
+  return ra->f < rb->f || (ra->f == rb->f && ra->g > rb->g);
+}
+
+static void path__sift_up(path_grid* grid, u32 i) {
+  u32 cell = grid->heap[i];
+  while (i > 0) {
+    u32 parent = (i - 1) / 2;
+    if (!path__less(grid, cell, grid->heap[parent])) break;
+    grid->heap[i] = grid->heap[parent];
+    grid->records[grid->heap[i]].heap_index = i;
+    i = parent;
   }
+  grid->heap[i] = cell;
+  grid->records[cell].heap_index = i;
 }
 
-ATS_API u32 sm_index(spatial_map* map, i32 x, i32 y) {
-  u32 hash = hash2i(x, y);
-  return hash & SPATIAL_TABLE_MOD;
+static void path__sift_down(path_grid* grid, u32 i) {
+  u32 cell = grid->heap[i];
+  for (;;) {
+    u32 j = 2 * i + 1;
+    if (j >= grid->heap_count) break;
+    if (j + 1 < grid->heap_count && path__less(grid, grid->heap[j + 1], grid->heap[j])) j++;
+    if (!path__less(grid, grid->heap[j], cell)) break;
+    grid->heap[i] = grid->heap[j];
+    grid->records[grid->heap[i]].heap_index = i;
+    i = j;
+  }
+  grid->heap[i] = cell;
+  grid->records[cell].heap_index = i;
 }
 
-ATS_API sm_node* sm_get(spatial_map* map, i32 x, i32 y) {
-  u32 index = sm_index(map, x, y);
-  return map->table[index];
+static u32 path__pop(path_grid* grid) {
+  u32 cell = grid->heap[0];
+  if (--grid->heap_count) {
+    grid->heap[0] = grid->heap[grid->heap_count];
+    path__sift_down(grid, 0);
+  }
+  grid->records[cell].heap_index = PATH_CLOSED;
+  return cell;
 }
 
-ATS_API void sm_add(spatial_map* map, void* e, r2 e_rect) {
-  r2i rect = {
-    { (i32)e_rect.min.x, (i32)e_rect.min.y },
-    { (i32)e_rect.max.x, (i32)e_rect.max.y },
-  };
-  for_r2(rect, x, y) {
-    u32 index = sm_index(map, x, y);
-    sm_node* node = mem_type(sm_node);
-    node->e = e;
-    node->rect = e_rect;
-    node->next = map->table[index];
-    map->table[index] = node;
+// opens 'cell' or lowers its cost if the new route through 'parent' is cheaper.
+static void path__relax(path_grid* grid, u32 cell, u32 parent, f32 g, f32 h) {
+  path_record* record = &grid->records[cell];
+
+  if (record->generation != grid->generation) {
+    record->generation = grid->generation;
+    record->parent = parent;
+    record->g = g;
+    record->f = g + h;
+    record->heap_index = grid->heap_count;
+    grid->heap[grid->heap_count++] = cell;
+    path__sift_up(grid, record->heap_index);
+  } else if (record->heap_index != PATH_CLOSED && g < record->g) {
+    record->parent = parent;
+    record->g = g;
+    record->f = g + h;
+    path__sift_up(grid, record->heap_index);
   }
 }
 
-ATS_API sm_node* sm_in_range(spatial_map* map, v2 pos, v2 rad, void* ignore) {
-  sm_node* result = 0;
+// ---------------- jump point search, no corner cutting: diagonal steps need both sides open ---------------- //
+
+// walks from (x, y) in direction (dx, dy) until it finds a cell with a forced neighbor or the goal.
+static b32 path__jump(path_grid* grid, i32 x, i32 y, i32 dx, i32 dy, v2i goal, v2i* out) {
+  for (;;) {
+    if (!path__open(grid, x, y)) return 0;
+    if (x == goal.x && y == goal.y) break;
+
+    if (dx && dy) {
+      // a diagonal step stops wherever one of its straight components finds something.
+      if (path__jump(grid, x + dx, y, dx, 0, goal, 0) || path__jump(grid, x, y + dy, 0, dy, goal, 0)) break;
+      if (!path__open(grid, x + dx, y) || !path__open(grid, x, y + dy)) return 0;
+    } else if (dx) {
+      if ((path__open(grid, x, y - 1) && !path__open(grid, x - dx, y - 1)) ||
+          (path__open(grid, x, y + 1) && !path__open(grid, x - dx, y + 1))) break;
+    } else {
+      if ((path__open(grid, x - 1, y) && !path__open(grid, x - 1, y - dy)) ||
+          (path__open(grid, x + 1, y) && !path__open(grid, x + 1, y - dy))) break;
+    }
 
-  r2 rect = {
-    { pos.x - rad.x, pos.y - rad.y },
-    { pos.x + rad.x, pos.y + rad.y },
-  };
+    x += dx;
+    y += dy;
+  }
 
-  r2i irect = {
-    { (i32)(pos.x - rad.x), (i32)(pos.y - rad.y) },
-    { (i32)(pos.x + rad.x), (i32)(pos.y + rad.y) },
-  };
+  if (out) *out = v2i(x, y);
+  return 1;
+}
 
-  for_r2(irect, x, y) {
-    u32 index = sm_index(map, x, y);
+// directions worth following from (x, y) when it was reached going (dx, dy), all of them for the start.
+static u32 path__jps_directions(path_grid* grid, i32 x, i32 y, i32 dx, i32 dy, v2i* dirs) {
+  u32 count = 0;
 
-    for (sm_node* it = map->table[index]; it; it = it->next) {
-      b32 unique = 1;
-      if ((it->e == ignore) || !r2_intersect(rect, it->rect)) continue;
+  if (!dx && !dy) {
+    for (i32 j = -1; j <= 1; ++j) {
+      for (i32 i = -1; i <= 1; ++i) {
+        if ((!i && !j) || (i && j && (!path__open(grid, x + i, y) || !path__open(grid, x, y + j)))) continue;
+        dirs[count++] = v2i(i, j);
+      }
+    }
+    return count;
+  }
 
-      for (sm_node* r = result; r; r = r->next) {
-        if (r->e == it->e) {
-          unique = 0;
-          break;
+  if (dx && dy) {
+    b32 open_x = path__open(grid, x + dx, y);
+    b32 open_y = path__open(grid, x, y + dy);
+    if (open_y) dirs[count++] = v2i(0, dy);
+    if (open_x) dirs[count++] = v2i(dx, 0);
+    if (open_x && open_y) dirs[count++] = v2i(dx, dy);
+  } else if (dx) {
+    b32 open_next = path__open(grid, x + dx, y);
+    b32 open_up = path__open(grid, x, y + 1);
+    b32 open_down = path__open(grid, x, y - 1);
+    if (open_next) {
+      dirs[count++] = v2i(dx, 0);
+      if (open_up) dirs[count++] = v2i(dx, 1);
+      if (open_down) dirs[count++] = v2i(dx, -1);
+    }
+    if (open_up) dirs[count++] = v2i(0, 1);
+    if (open_down) dirs[count++] = v2i(0, -1);
+  } else {
+    b32 open_next = path__open(grid, x, y + dy);
+    b32 open_right = path__open(grid, x + 1, y);
+    b32 open_left = path__open(grid, x - 1, y);
+    if (open_next) {
+      dirs[count++] = v2i(0, dy);
+      if (open_right) dirs[count++] = v2i(1, dy);
+      if (open_left) dirs[count++] = v2i(-1, dy);
+    }
+    if (open_right) dirs[count++] = v2i(1, 0);
+    if (open_left) dirs[count++] = v2i(-1, 0);
+  }
+  return count;
+}
+
+static v2i path__cell_pos(path_grid* grid, u32 cell) {
+  return v2i((i32)(cell % (u32)grid->width), (i32)(cell / (u32)grid->width));
+}
+
+// writes the path into out, jump point segments are filled in cell by cell.
+static u32 path__build(path_grid* grid, u32 goal, v2i* out, u32 out_max) {
+  u32 count = 1;
+  for (u32 cell = goal; grid->records[cell].parent != cell; cell = grid->records[cell].parent) {
+    v2i a = path__cell_pos(grid, cell);
+    v2i b = path__cell_pos(grid, grid->records[cell].parent);
+    count += (u32)max(abs(a.x - b.x), abs(a.y - b.y));
+  }
+
+  u32 index = count;
+  for (u32 cell = goal;; cell = grid->records[cell].parent) {
+    u32 parent = grid->records[cell].parent;
+    v2i pos = path__cell_pos(grid, cell);
+    v2i end = path__cell_pos(grid, parent);
+    i32 dx = sign(end.x - pos.x);
+    i32 dy = sign(end.y - pos.y);
+
+    do {
+      if (--index < out_max) out[index] = pos;
+      pos.x += dx;
+      pos.y += dy;
+    } while (pos.x != end.x || pos.y != end.y);
+
+    if (parent == cell) break;
+  }
+  return count;
+}
+
+ATS_API u32 path_find(path_grid* grid, v2i start, v2i goal, u32 flags, v2i* out, u32 out_max) {
+  if (!path__open(grid, start.x, start.y) || !path__open(grid, goal.x, goal.y)) return 0;
+
+  b32 jps = flags & PATH_FLAG_JPS;
+  b32 diagonal = jps || (flags & PATH_FLAG_DIAGONAL);
+
+  // stamping records with the search generation saves clearing them between searches.
+  if (++grid->generation == 0) {
+    memset(grid->records, 0, (usize)grid->width * grid->height * sizeof (path_record));
+    grid->generation = 1;
+  }
+  grid->heap_count = 0;
+
+  u32 start_cell = (u32)(start.x + start.y * grid->width);
+  u32 goal_cell = (u32)(goal.x + goal.y * grid->width);
+
+  path__relax(grid, start_cell, start_cell, 0, path__heuristic(goal.x - start.x, goal.y - start.y, diagonal));
+
+  while (grid->heap_count) {
+    u32 cell = path__pop(grid);
+    if (cell == goal_cell) return path__build(grid, cell, out, out_max);
+
+    path_record* record = &grid->records[cell];
+    v2i pos = path__cell_pos(grid, cell);
+    f32 g = record->g;
+
+    if (jps) {
+      v2i from = path__cell_pos(grid, record->parent);
+      v2i dirs[8];
+      u32 dir_count = path__jps_directions(grid, pos.x, pos.y, sign(pos.x - from.x), sign(pos.y - from.y), dirs);
+
+      for (u32 i = 0; i < dir_count; ++i) {
+        v2i jump;
+        if (!path__jump(grid, pos.x + dirs[i].x, pos.y + dirs[i].y, dirs[i].x, dirs[i].y, goal, &jump)) continue;
+
+        u32 next = (u32)(jump.x + jump.y * grid->width);
+        f32 cost = path__heuristic(jump.x - pos.x, jump.y - pos.y, 1);
+        path__relax(grid, next, cell, g + cost, path__heuristic(goal.x - jump.x, goal.y - jump.y, 1));
+      }
+    } else {
+      for (i32 dy = -1; dy <= 1; ++dy) {
+        for (i32 dx = -1; dx <= 1; ++dx) {
+          if (!dx && !dy) continue;
+          if (dx && dy && (!diagonal || !path__open(grid, pos.x + dx, pos.y) || !path__open(grid, pos.x, pos.y + dy))) continue;
+
+          i32 x = pos.x + dx;
+          i32 y = pos.y + dy;
+          if (!path__open(grid, x, y)) continue;
+
+          f32 cost = dx && dy? PATH_SQRT2 : 1.0f;
+          path__relax(grid, (u32)(x + y * grid->width), cell, g + cost, path__heuristic(goal.x - x, goal.y - y, diagonal));
         }
       }
+    }
+  }
+  return 0;
+}
+
+ATS_API f32 path_cost(path_grid* grid, v2i goal) {
+  u32 cell = (u32)(goal.x + goal.y * grid->width);
+  path_record* record = &grid->records[cell];
+  return record->generation == grid->generation && record->heap_index == PATH_CLOSED? record->g : -1.0f;
+}
+
+// ============================================= FLOW FIELD ============================================= //
+
+static const i32 flow__dx[8] = { 1, 1, 0, -1, -1, -1,  0,  1 };
+static const i32 flow__dy[8] = { 0, 1, 1,  1,  0, -1, -1, -1 };
+
+ATS_API flow_field flow_field_create(mem_arena* arena, i32 width, i32 height, const u32* passable) {
+  flow_field field = {0};
+  usize cell_count = (usize)width * height;
+
+  field.width = width;
+  field.height = height;
+  field.passable = passable;
+  field.tiles_x = (width + FLOW_TILE_SIZE - 1) / FLOW_TILE_SIZE;
+  field.tiles_y = (height + FLOW_TILE_SIZE - 1) / FLOW_TILE_SIZE;
+
+  u32 tile_count = (u32)(field.tiles_x * field.tiles_y);
+
+  field.cost = mem_array(f32, cell_count, arena, .flags = MEM_ALLOC_NO_ZERO);
+  field.dir = mem_array(u8, cell_count, arena, .flags = MEM_ALLOC_NO_ZERO);
+  field.tile_dirty = mem_array(u8, tile_count, arena);
+  field.tile_changed = mem_array(u8, tile_count, arena);
+  field.pass = mem_array(u32, tile_count, arena, .flags = MEM_ALLOC_NO_ZERO);
+
+  flow_field_set_goals(&field, 0, 0);
+  return field;
+}
+
+static b32 flow__open(flow_field* field, i32 x, i32 y) {
+  if ((u32)x >= (u32)field->width || (u32)y >= (u32)field->height) return 0;
+  u32 index = (u32)(x + y * field->width);
+  return (field->passable[index >> 5] >> (index & 31)) & 1;
+}
+
+// diagonal steps need both sides open, same as path_find.
+static b32 flow__can_step(flow_field* field, i32 x, i32 y, u32 d) {
+  i32 dx = flow__dx[d];
+  i32 dy = flow__dy[d];
+  if (!flow__open(field, x + dx, y + dy)) return 0;
+  return !(dx && dy) || (flow__open(field, x + dx, y) && flow__open(field, x, y + dy));
+}
+
+static u32 flow__tile_of(flow_field* field, i32 x, i32 y) {
+  return (u32)((x / FLOW_TILE_SIZE) + (y / FLOW_TILE_SIZE) * field->tiles_x);
+}
+
+ATS_API void flow_field_set_goals(flow_field* field, const v2i* goals, u32 goal_count) {
+  usize cell_count = (usize)field->width * field->height;
+  u32 tile_count = (u32)(field->tiles_x * field->tiles_y);
+
+  for (usize i = 0; i < cell_count; ++i) {
+    field->cost[i] = FLOW_UNREACHABLE;
+  }
+  memset(field->dir, FLOW_DIR_NONE, cell_count);
+  memset(field->tile_changed, 0, tile_count);
+
+  for (u32 i = 0; i < goal_count; ++i) {
+    if (flow__open(field, goals[i].x, goals[i].y)) {
+      field->cost[goals[i].x + goals[i].y * field->width] = 0;
+    }
+  }
+
+  memset(field->tile_dirty, goal_count? 1 : 0, tile_count);
+  field->pass_count = 0;
+}
 
-      if (unique) {
-        sm_node* n = mem_type(sm_node);
-        *n = *it;
-        n->next = result;
-        result = n;
+ATS_API u32 flow_field_begin_pass(flow_field* field) {
+  // tiles of one color never touch, not even diagonally, so they can be solved at the same time.
+  for (u32 tries = 0; tries < 4; ++tries) {
+    u32 color = field->color;
+    u32 count = 0;
+
+    field->color = (color + 1) & 3;
+
+    for (i32 ty = (i32)(color >> 1); ty < field->tiles_y; ty += 2) {
+      for (i32 tx = (i32)(color & 1); tx < field->tiles_x; tx += 2) {
+        u32 tile = (u32)(tx + ty * field->tiles_x);
+        if (field->tile_dirty[tile]) {
+          field->tile_dirty[tile] = 0;
+          field->pass[count++] = tile;
+        }
       }
     }
+
+    if (count) {
+      field->pass_count = count;
+      return count;
+    }
   }
-  return result;
+
+  field->pass_count = 0;
+  return 0;
 }
 
-ATS_API void* sm_get_closest(spatial_map* map, v2 pos, f32 range, void* ignore, b32 (*condition_proc)(void*)) {
-  void* result = 0;
-  f32 distance = range;
+// which neighbor tiles (as directions) a cell at local (lx, ly) borders.
+static u8 flow__border_mask(i32 lx, i32 ly, i32 w, i32 h) {
+  u8 mask = 0;
+  b32 e = lx == w - 1, s = ly == h - 1, west = lx == 0, n = ly == 0;
+  if (e) mask |= 1 << 0;
+  if (e && s) mask |= 1 << 1;
+  if (s) mask |= 1 << 2;
+  if (west && s) mask |= 1 << 3;
+  if (west) mask |= 1 << 4;
+  if (west && n) mask |= 1 << 5;
+  if (n) mask |= 1 << 6;
+  if (e && n) mask |= 1 << 7;
+  return mask;
+}
+
+ATS_API void flow_field_run(flow_field* field, u32 pass_index) {
+  u32 tile = field->pass[pass_index];
+  i32 tx = (i32)(tile % (u32)field->tiles_x);
+  i32 ty = (i32)(tile / (u32)field->tiles_x);
+  i32 x0 = tx * FLOW_TILE_SIZE;
+  i32 y0 = ty * FLOW_TILE_SIZE;
+  i32 w = min(FLOW_TILE_SIZE, field->width - x0);
+  i32 h = min(FLOW_TILE_SIZE, field->height - y0);
+  u8 changed = 0;
+
+  f32* cost = field->cost;
+  u8* dir = field->dir;
+
+  mem_scratch_scope(scratch, 0) {
+    // every cell is pushed at most once as a seed and once per improvement from one of its 8 neighbors.
+    path_queue queue = {0};
+    queue.buf = mem_array(path_node, (usize)w * h * 9 + 1, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+    // seed with what is known inside the tile and whatever the neighbor tiles offer across the border.
+    for (i32 ly = 0; ly < h; ++ly) {
+      for (i32 lx = 0; lx < w; ++lx) {
+        i32 x = x0 + lx;
+        i32 y = y0 + ly;
+        u32 index = (u32)(x + y * field->width);
+
+        if (!flow__open(field, x, y)) continue;
+
+        if (lx == 0 || ly == 0 || lx == w - 1 || ly == h - 1) {
+          for (u32 d = 0; d < 8; ++d) {
+            i32 nx = x + flow__dx[d];
+            i32 ny = y + flow__dy[d];
+            if (nx >= x0 && nx < x0 + w && ny >= y0 && ny < y0 + h) continue;
+            if (!flow__can_step(field, x, y, d)) continue;
+
+            f32 c = cost[nx + ny * field->width] + ((flow__dx[d] && flow__dy[d])? PATH_SQRT2 : 1.0f);
+            if (c < cost[index]) {
+              cost[index] = c;
+              dir[index] = (u8)d;
+              changed |= flow__border_mask(lx, ly, w, h);
+            }
+          }
+        }
 
-  for (sm_node* it = sm_in_range(map, pos, v2(range, range), ignore); it; it = it->next) {
-    if (condition_proc && !condition_proc(it->e)) continue;
+        if (cost[index] < FLOW_UNREACHABLE) {
+          path_queue_push(&queue, path_node(cost[index], x, y, 0));
+        }
+      }
+    }
 
-    v2 e_pos = {
-      0.5f * (it->rect.min.x + it->rect.max.x),
-      0.5f * (it->rect.min.y + it->rect.max.y),
-    };
+    while (!path_queue_empty(&queue)) {
+      path_node node = path_queue_pop(&queue);
+      if (node.w > cost[node.x + node.y * field->width]) continue; // stale entry
+
+      for (u32 d = 0; d < 8; ++d) {
+        i32 nx = node.x + flow__dx[d];
+        i32 ny = node.y + flow__dy[d];
+        if (nx < x0 || nx >= x0 + w || ny < y0 || ny >= y0 + h) continue;
+        if (!flow__can_step(field, node.x, node.y, d)) continue;
+
+        u32 index = (u32)(nx + ny * field->width);
+        f32 c = node.w + ((flow__dx[d] && flow__dy[d])? PATH_SQRT2 : 1.0f);
+        if (c < cost[index]) {
+          cost[index] = c;
+          dir[index] = (u8)((d + 4) & 7);
+          changed |= flow__border_mask(nx - x0, ny - y0, w, h);
+          path_queue_push(&queue, path_node(c, nx, ny, 0));
+        }
+      }
+    }
+  }
+
+  field->tile_changed[tile] = changed;
+}
+
+ATS_API void flow_field_end_pass(flow_field* field) {
+  for (u32 i = 0; i < field->pass_count; ++i) {
+    u32 tile = field->pass[i];
+    u8 changed = field->tile_changed[tile];
+    if (!changed) continue;
 
-    f32 new_distance = v2_dist(e_pos, pos);
+    i32 tx = (i32)(tile % (u32)field->tiles_x);
+    i32 ty = (i32)(tile / (u32)field->tiles_x);
 
-    if (new_distance <= distance) {
-      result = it->e;
-      distance = new_distance;
+    for (u32 d = 0; d < 8; ++d) {
+      i32 nx = tx + flow__dx[d];
+      i32 ny = ty + flow__dy[d];
+      if ((changed & (1 << d)) && (u32)nx < (u32)field->tiles_x && (u32)ny < (u32)field->tiles_y) {
+        field->tile_dirty[nx + ny * field->tiles_x] = 1;
+      }
     }
+    field->tile_changed[tile] = 0;
   }
+  field->pass_count = 0;
+}
 
-  return result;
+ATS_API void flow_field_build(flow_field* field) {
+  while (flow_field_begin_pass(field)) {
+    for (u32 i = 0; i < field->pass_count; ++i) {
+      flow_field_run(field, i);
+    }
+    flow_field_end_pass(field);
+  }
 }
 
-ATS_API void* sm_at_position(spatial_map* map, v2 pos) {
-  u32 index = sm_index(map, pos.x, pos.y);
-  for (sm_node* it = map->table[index]; it; it = it->next) {
-    if (r2_contains(it->rect, pos)) {
-      return it->e;
+ATS_API void flow_field_update(flow_field* field, const v2i* cells, u32 cell_count) {
+  i32 width = field->width;
+  f32* cost = field->cost;
+  u8* dir = field->dir;
+
+  mem_scratch_scope(scratch, 0) {
+    u32 stack_count = 0;
+    u32 stack_cap = 1024;
+    u32* stack = mem_array(u32, stack_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+    for (u32 i = 0; i < cell_count; ++i) {
+      i32 x = cells[i].x;
+      i32 y = cells[i].y;
+      if ((u32)x >= (u32)width || (u32)y >= (u32)field->height) continue;
+
+      field->tile_dirty[flow__tile_of(field, x, y)] = 1;
+      if (flow__open(field, x, y)) continue; // opened cells are picked up by solving their tile
+
+      // a blocked cell takes down its own cost and every neighbor whose step is no longer possible.
+      for (u32 d = 0; d < 9; ++d) {
+        i32 nx = d < 8? x + flow__dx[d] : x;
+        i32 ny = d < 8? y + flow__dy[d] : y;
+        if ((u32)nx >= (u32)width || (u32)ny >= (u32)field->height) continue;
+
+        u32 index = (u32)(nx + ny * width);
+        if (cost[index] == FLOW_UNREACHABLE) continue;
+        if (d < 8 && (dir[index] == FLOW_DIR_NONE || flow__can_step(field, nx, ny, dir[index]))) continue;
+
+        cost[index] = FLOW_UNREACHABLE;
+        dir[index] = FLOW_DIR_NONE;
+
+        if (stack_count == stack_cap) {
+          u32* new_stack = mem_array(u32, 2 * stack_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+          memcpy(new_stack, stack, stack_count * sizeof (u32));
+          stack = new_stack;
+          stack_cap *= 2;
+        }
+        stack[stack_count++] = index;
+      }
+    }
+
+    // everything downstream of an invalidated cell got its cost through it, so it goes too.
+    while (stack_count) {
+      u32 index = stack[--stack_count];
+      i32 x = (i32)(index % (u32)width);
+      i32 y = (i32)(index / (u32)width);
+
+      field->tile_dirty[flow__tile_of(field, x, y)] = 1;
+
+      for (u32 d = 0; d < 8; ++d) {
+        i32 nx = x + flow__dx[d];
+        i32 ny = y + flow__dy[d];
+        if ((u32)nx >= (u32)width || (u32)ny >= (u32)field->height) continue;
+
+        u32 child = (u32)(nx + ny * width);
+        if (dir[child] != ((d + 4) & 7) || cost[child] == FLOW_UNREACHABLE) continue;
+
+        cost[child] = FLOW_UNREACHABLE;
+        dir[child] = FLOW_DIR_NONE;
+
+        if (stack_count == stack_cap) {
+          u32* new_stack = mem_array(u32, 2 * stack_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+          memcpy(new_stack, stack, stack_count * sizeof (u32));
+          stack = new_stack;
+          stack_cap *= 2;
+        }
+        stack[stack_count++] = child;
+      }
     }
   }
-  return 0;
 }
 
+ATS_API v2 flow_field_dir(flow_field* field, v2i cell) {
+  static const v2 dirs[FLOW_DIR_NONE + 1] = {
+    {  1.0f,        0.0f        },
+    {  0.70710678f, 0.70710678f },
+    {  0.0f,        1.0f        },
+    { -0.70710678f, 0.70710678f },
+    { -1.0f,        0.0f        },
+    { -0.70710678f, -0.70710678f },
+    {  0.0f,       -1.0f        },
+    {  0.70710678f, -0.70710678f },
+    {  0.0f,        0.0f        },
+  };
+  if ((u32)cell.x >= (u32)field->width || (u32)cell.y >= (u32)field->height) return dirs[FLOW_DIR_NONE];
+  return dirs[field->dir[cell.x + cell.y * field->width]];
+}
+
+ATS_API f32 flow_field_cost(flow_field* field, v2i cell) {
+  if ((u32)cell.x >= (u32)field->width || (u32)cell.y >= (u32)field->height) return FLOW_UNREACHABLE;
+  return field->cost[cell.x + cell.y * field->width];
+}
+
+// ============================================== HPA* ============================================== //
+
+#define HPA_START(hpa) ((u32)((hpa)->clusters_x * (hpa)->clusters_y) * HPA_CLUSTER_NODES)
+#define HPA_GOAL(hpa)  (HPA_START(hpa) + 1)
+
+#define HPA_DIRTY_BORDERS (1 << 0)
+#define HPA_DIRTY_COSTS   (1 << 1)
+
+static b32 hpa__open(hpa_map* hpa, i32 x, i32 y) {
+  if ((u32)x >= (u32)hpa->width || (u32)y >= (u32)hpa->height) return 0;
+  u32 index = (u32)(x + y * hpa->width);
+  return (hpa->passable[index >> 5] >> (index & 31)) & 1;
+}
+
+static r2i hpa__bounds(hpa_map* hpa, u32 cluster) {
+  i32 cx = (i32)(cluster % (u32)hpa->clusters_x);
+  i32 cy = (i32)(cluster / (u32)hpa->clusters_x);
+  r2i result = {
+    { cx * HPA_CLUSTER_SIZE, cy * HPA_CLUSTER_SIZE },
+    { min((cx + 1) * HPA_CLUSTER_SIZE, hpa->width) - 1, min((cy + 1) * HPA_CLUSTER_SIZE, hpa->height) - 1 },
+  };
+  return result;
+}
+
+static u32 hpa__cluster_of(hpa_map* hpa, v2i pos) {
+  return (u32)(pos.x / HPA_CLUSTER_SIZE + (pos.y / HPA_CLUSTER_SIZE) * hpa->clusters_x);
+}
+
+static b32 hpa__valid_slot(hpa_cluster* cluster, u32 slot) {
+  return slot % HPA_BORDER_NODES < cluster->border_count[slot / HPA_BORDER_NODES];
+}
+
+static u32 hpa__entrance_count(hpa_cluster* cluster) {
+  return cluster->border_count[0] + cluster->border_count[1] + cluster->border_count[2] + cluster->border_count[3];
+}
+
+// the row / column of a slot in the cluster's costs, entrances are numbered border by border.
+static u32 hpa__entrance(hpa_cluster* cluster, u32 slot) {
+  u32 border = slot / HPA_BORDER_NODES;
+  u32 index = slot % HPA_BORDER_NODES;
+  for (u32 b = 0; b < border; ++b) {
+    index += cluster->border_count[b];
+  }
+  return index;
+}
+
+static v2i hpa__node_pos(hpa_map* hpa, u32 cluster, u32 slot) {
+  r2i b = hpa__bounds(hpa, cluster);
+  i32 offset = hpa->clusters[cluster].offset[slot];
+  switch (slot / HPA_BORDER_NODES) {
+    case 0:  return v2i(b.max.x, b.min.y + offset);
+    case 1:  return v2i(b.min.x + offset, b.max.y);
+    case 2:  return v2i(b.min.x, b.min.y + offset);
+    default: return v2i(b.min.x + offset, b.min.y);
+  }
+}
+
+ATS_API hpa_map hpa_create(mem_arena* arena, i32 width, i32 height, const u32* passable) {
+  hpa_map hpa = {0};
+
+  hpa.width = width;
+  hpa.height = height;
+  hpa.passable = passable;
+  hpa.clusters_x = (width + HPA_CLUSTER_SIZE - 1) / HPA_CLUSTER_SIZE;
+  hpa.clusters_y = (height + HPA_CLUSTER_SIZE - 1) / HPA_CLUSTER_SIZE;
+
+  u32 cluster_count = (u32)(hpa.clusters_x * hpa.clusters_y);
+
+  hpa.clusters = mem_array(hpa_cluster, cluster_count, arena);
+  hpa.arena = arena;
+  hpa.dirty = mem_array(u8, cluster_count, arena, .flags = MEM_ALLOC_NO_ZERO);
+  hpa.records = mem_array(hpa_record, cluster_count * HPA_CLUSTER_NODES + 2, arena);
+
+  // everything is built on the first search.
+  memset(hpa.dirty, HPA_DIRTY_BORDERS | HPA_DIRTY_COSTS, cluster_count);
+  hpa.dirty_count = cluster_count;
+
+  return hpa;
+}
+
+ATS_API void hpa_update(hpa_map* hpa, const v2i* cells, u32 cell_count) {
+  for (u32 i = 0; i < cell_count; ++i) {
+    if ((u32)cells[i].x >= (u32)hpa->width || (u32)cells[i].y >= (u32)hpa->height) continue;
+
+    u32 cluster = hpa__cluster_of(hpa, cells[i]);
+    if (!hpa->dirty[cluster]) hpa->dirty_count++;
+    hpa->dirty[cluster] = HPA_DIRTY_BORDERS | HPA_DIRTY_COSTS;
+  }
+}
+
+// finds the entrances on the +x (border 0) or +y (border 1) side of a cluster and stores them
+// in both clusters, so an entrance and its partner across the border share their index.
+static void hpa__scan_border(hpa_map* hpa, i32 cx, i32 cy, u32 border) {
+  i32 nx = cx + (border == 0);
+  i32 ny = cy + (border == 1);
+  u32 cluster = (u32)(cx + cy * hpa->clusters_x);
+  hpa_cluster* a = &hpa->clusters[cluster];
+
+  if (nx >= hpa->clusters_x || ny >= hpa->clusters_y) {
+    a->border_count[border] = 0;
+    return;
+  }
+
+  hpa_cluster* b = &hpa->clusters[nx + ny * hpa->clusters_x];
+  r2i bounds = hpa__bounds(hpa, cluster);
+  i32 length = border == 0? bounds.max.y - bounds.min.y + 1 : bounds.max.x - bounds.min.x + 1;
+  u32 count = 0;
+  u8* offset = &a->offset[border * HPA_BORDER_NODES];
+
+  for (i32 i = 0; i <= length; ++i) {
+    i32 run_start = i;
+    while (i < length) {
+      i32 x = border == 0? bounds.max.x : bounds.min.x + i;
+      i32 y = border == 0? bounds.min.y + i : bounds.max.y;
+      if (!hpa__open(hpa, x, y) || !hpa__open(hpa, x + (border == 0), y + (border == 1))) break;
+      i++;
+    }
+
+    i32 run = i - run_start;
+    if (!run) continue;
+
+    // long entrances get one at each end, so paths don't all squeeze through the middle.
+    if (run >= HPA_LONG_ENTRANCE) {
+      offset[count++] = (u8)run_start;
+      offset[count++] = (u8)(i - 1);
+    } else {
+      offset[count++] = (u8)(run_start + run / 2);
+    }
+  }
+
+  assert(count <= HPA_BORDER_NODES);
+  a->border_count[border] = (u8)count;
+  b->border_count[border + 2] = (u8)count;
+  memcpy(&b->offset[(border + 2) * HPA_BORDER_NODES], offset, count);
+}
+
+// one bit per direction a cell can step in without leaving 'bounds'.
+static void hpa__moves(hpa_map* hpa, r2i bounds, u8* moves) {
+  i32 w = bounds.max.x - bounds.min.x + 1;
+
+  for_r2(bounds, x, y) {
+    u8 mask = 0;
+    if (hpa__open(hpa, x, y)) {
+      for (u32 d = 0; d < 8; ++d) {
+        i32 dx = flow__dx[d];
+        i32 dy = flow__dy[d];
+        if (x + dx < bounds.min.x || x + dx > bounds.max.x || y + dy < bounds.min.y || y + dy > bounds.max.y) continue;
+        if (!hpa__open(hpa, x + dx, y + dy)) continue;
+        if (dx && dy && (!hpa__open(hpa, x + dx, y) || !hpa__open(hpa, x, y + dy))) continue;
+        mask |= 1 << d;
+      }
+    }
+    moves[(x - bounds.min.x) + (y - bounds.min.y) * w] = mask;
+  }
+}
+
+// dijkstra from 'from' over the cells of 'bounds', dir points each cell one step back towards 'from'.
+// with 'targets' (a count per cell) it stops once 'target_count' of them are settled.
+static void hpa__dijkstra(r2i bounds, const u8* moves, v2i from, f32* dist, u8* dir, u8* targets, u32 target_count, mem_arena* scratch) {
+  i32 w = bounds.max.x - bounds.min.x + 1;
+  i32 h = bounds.max.y - bounds.min.y + 1;
+
+  for (i32 i = 0; i < w * h; ++i) {
+    dist[i] = FLOW_UNREACHABLE;
+    dir[i] = FLOW_DIR_NONE;
+  }
+
+  path_queue queue = {0};
+  queue.buf = mem_array(path_node, (usize)w * h * 8 + 2, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+  // local coordinates from here on.
+  dist[(from.x - bounds.min.x) + (from.y - bounds.min.y) * w] = 0;
+  path_queue_push(&queue, path_node(0, from.x - bounds.min.x, from.y - bounds.min.y, 0));
+
+  while (!path_queue_empty(&queue)) {
+    path_node node = path_queue_pop(&queue);
+    u32 node_index = (u32)(node.x + node.y * w);
+    if (node.w > dist[node_index]) continue;
+
+    if (targets && targets[node_index]) {
+      target_count -= targets[node_index];
+      targets[node_index] = 0;
+      if (!target_count) break;
+    }
+
+    u8 mask = moves[node_index];
+    for (u32 d = 0; d < 8; ++d) {
+      if (!(mask & (1 << d))) continue;
+
+      i32 dx = flow__dx[d];
+      i32 dy = flow__dy[d];
+      u32 index = (u32)((node.x + dx) + (node.y + dy) * w);
+      f32 c = node.w + ((dx && dy)? PATH_SQRT2 : 1.0f);
+      if (c < dist[index]) {
+        dist[index] = c;
+        dir[index] = (u8)((d + 4) & 7);
+        path_queue_push(&queue, path_node(c, node.x + dx, node.y + dy, 0));
+      }
+    }
+  }
+}
+
+// gives every cluster room for the costs of the entrances it has now. clusters that aren't rebuilt
+// keep their costs, their entrances didn't change.
+static void hpa__layout_costs(hpa_map* hpa) {
+  u32 cluster_count = (u32)(hpa->clusters_x * hpa->clusters_y);
+  usize total = 0;
+  b32 changed = 0;
+
+  for (u32 i = 0; i < cluster_count; ++i) {
+    u32 n = hpa__entrance_count(&hpa->clusters[i]);
+    total += n * n;
+    changed |= n != hpa->clusters[i].cost_count;
+  }
+  if (!changed) return;
+
+  assert(total <= 0xffffffffu);
+
+  if (total > hpa->cost_cap) {
+    u32 cap = (u32)max(total + total / 4, (usize)2 * hpa->cost_cap);
+    f32* costs = mem_array(f32, cap, hpa->arena, .flags = MEM_ALLOC_NO_ZERO);
+
+    u32 offset = 0;
+    for (u32 i = 0; i < cluster_count; ++i) {
+      hpa_cluster* cluster = &hpa->clusters[i];
+      u32 n = hpa__entrance_count(cluster);
+      if (!(hpa->dirty[i] & HPA_DIRTY_COSTS) && n) {
+        memcpy(costs + offset, hpa->costs + cluster->cost_offset, n * n * sizeof (f32));
+      }
+      cluster->cost_count = n;
+      cluster->cost_offset = offset;
+      offset += n * n;
+    }
+
+    hpa->costs = costs;
+    hpa->cost_cap = cap;
+    return;
+  }
+
+  // in place: the ones moving right go back to front and the ones moving left front to back,
+  // so no costs are overwritten before they are moved.
+  u32 offset = (u32)total;
+  for (u32 i = cluster_count; i-- > 0;) {
+    hpa_cluster* cluster = &hpa->clusters[i];
+    u32 n = hpa__entrance_count(cluster);
+    b32 keep = !(hpa->dirty[i] & HPA_DIRTY_COSTS);
+    offset -= n * n;
+
+    if (keep && offset < cluster->cost_offset) continue;
+    if (keep && offset > cluster->cost_offset) {
+      memmove(hpa->costs + offset, hpa->costs + cluster->cost_offset, n * n * sizeof (f32));
+    }
+    cluster->cost_count = n;
+    cluster->cost_offset = offset;
+  }
+
+  for (u32 i = 0; i < cluster_count; ++i) {
+    hpa_cluster* cluster = &hpa->clusters[i];
+    u32 n = hpa__entrance_count(cluster);
+
+    if (offset < cluster->cost_offset) {
+      memmove(hpa->costs + offset, hpa->costs + cluster->cost_offset, n * n * sizeof (f32));
+      cluster->cost_offset = offset;
+    }
+    offset += n * n;
+  }
+}
+
+static void hpa__build_costs(hpa_map* hpa, u32 index, mem_arena* scratch) {
+  hpa_cluster* cluster = &hpa->clusters[index];
+  r2i bounds = hpa__bounds(hpa, index);
+  i32 w = bounds.max.x - bounds.min.x + 1;
+
+  u32 n = cluster->cost_count;
+  f32* cost = hpa->costs + cluster->cost_offset;
+
+  for (u32 i = 0; i < n * n; ++i) {
+    cost[i] = FLOW_UNREACHABLE;
+  }
+
+  mem_scope(scratch) {
+    f32* dist = mem_array(f32, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    u8* dir = mem_array(u8, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+    u8* targets = mem_array(u8, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch);
+    u8* moves = mem_array(u8, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+    hpa__moves(hpa, bounds, moves);
+
+    // costs are symmetric, every search only has to reach the slots after its own.
+    for (u32 s = 0; s < HPA_CLUSTER_NODES; ++s) {
+      if (!hpa__valid_slot(cluster, s)) continue;
+
+      u32 target_count = 0;
+      for (u32 t = s + 1; t < HPA_CLUSTER_NODES; ++t) {
+        if (!hpa__valid_slot(cluster, t)) continue;
+        v2i pos = hpa__node_pos(hpa, index, t);
+        targets[(pos.x - bounds.min.x) + (pos.y - bounds.min.y) * w]++;
+        target_count++;
+      }
+      if (!target_count) continue;
+
+      mem_scope(scratch) {
+        hpa__dijkstra(bounds, moves, hpa__node_pos(hpa, index, s), dist, dir, targets, target_count, scratch);
+      }
+
+      u32 si = hpa__entrance(cluster, s);
+      u32 ti = si + 1;
+      for (u32 t = s + 1; t < HPA_CLUSTER_NODES; ++t) {
+        if (!hpa__valid_slot(cluster, t)) continue;
+        v2i pos = hpa__node_pos(hpa, index, t);
+        u32 cell = (u32)((pos.x - bounds.min.x) + (pos.y - bounds.min.y) * w);
+        cost[si * n + ti] = dist[cell];
+        cost[ti * n + si] = dist[cell];
+        targets[cell] = 0; // unreachable targets are still counted
+        ti++;
+      }
+    }
+  }
+}
+
+static void hpa__rebuild(hpa_map* hpa) {
+  if (!hpa->dirty_count) return;
+
+  u32 cluster_count = (u32)(hpa->clusters_x * hpa->clusters_y);
+
+  // borders first, a changed border changes the entrances of the cluster on the other side too.
+  for (u32 i = 0; i < cluster_count; ++i) {
+    if (!(hpa->dirty[i] & HPA_DIRTY_BORDERS)) continue;
+
+    i32 cx = (i32)(i % (u32)hpa->clusters_x);
+    i32 cy = (i32)(i / (u32)hpa->clusters_x);
+
+    hpa__scan_border(hpa, cx, cy, 0);
+    hpa__scan_border(hpa, cx, cy, 1);
+    if (cx > 0) hpa__scan_border(hpa, cx - 1, cy, 0);
+    if (cy > 0) hpa__scan_border(hpa, cx, cy - 1, 1);
+
+    if (cx > 0) hpa->dirty[i - 1] |= HPA_DIRTY_COSTS;
+    if (cy > 0) hpa->dirty[i - hpa->clusters_x] |= HPA_DIRTY_COSTS;
+    if (cx + 1 < hpa->clusters_x) hpa->dirty[i + 1] |= HPA_DIRTY_COSTS;
+    if (cy + 1 < hpa->clusters_y) hpa->dirty[i + hpa->clusters_x] |= HPA_DIRTY_COSTS;
+  }
+
+  hpa__layout_costs(hpa);
+
+  mem_scratch_scope(scratch, 0) {
+    for (u32 i = 0; i < cluster_count; ++i) {
+      if (hpa->dirty[i] & HPA_DIRTY_COSTS) {
+        hpa__build_costs(hpa, i, scratch);
+      }
+      hpa->dirty[i] = 0;
+    }
+  }
+
+  hpa->dirty_count = 0;
+}
+
+static f32 hpa__heuristic(v2i a, v2i b) {
+  return path__heuristic(b.x - a.x, b.y - a.y, 1);
+}
+
+static void hpa__relax(hpa_map* hpa, path_queue* queue, u32* queue_cap, mem_arena* scratch, u32 id, u32 parent, f32 g, v2i pos, v2i goal) {
+  hpa_record* record = &hpa->records[id];
+
+  if (record->generation == hpa->generation && (record->closed || g >= record->g)) return;
+
+  record->generation = hpa->generation;
+  record->closed = 0;
+  record->parent = parent;
+  record->g = g;
+
+  // path_queue is 1 based and doesn't grow by itself.
+  if (queue->len + 2 > *queue_cap) {
+    path_node* buf = mem_array(path_node, 2 * *queue_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    memcpy(buf, queue->buf, (queue->len + 1) * sizeof (path_node));
+    queue->buf = buf;
+    *queue_cap *= 2;
+  }
+  path_queue_push(queue, path_node(g + hpa__heuristic(pos, goal), (i32)id, 0, 0));
+}
+
+static v2i hpa__id_pos(hpa_map* hpa, u32 id, v2i start, v2i goal) {
+  if (id == HPA_START(hpa)) return start;
+  if (id == HPA_GOAL(hpa)) return goal;
+  return hpa__node_pos(hpa, id / HPA_CLUSTER_NODES, id % HPA_CLUSTER_NODES);
+}
+
+ATS_API u32 hpa_find(hpa_map* hpa, v2i start, v2i goal, v2i* out, u32 out_max) {
+  hpa__rebuild(hpa);
+
+  if (!hpa__open(hpa, start.x, start.y) || !hpa__open(hpa, goal.x, goal.y)) return 0;
+
+  if (start.x == goal.x && start.y == goal.y) {
+    if (out_max) out[0] = start;
+    return 1;
+  }
+
+  u32 count = 0;
+  b32 direct = 0;
+  u32 start_id = HPA_START(hpa);
+  u32 goal_id = HPA_GOAL(hpa);
+  u32 start_cluster = hpa__cluster_of(hpa, start);
+  u32 goal_cluster = hpa__cluster_of(hpa, goal);
+  r2i start_bounds = hpa__bounds(hpa, start_cluster);
+  r2i goal_bounds = hpa__bounds(hpa, goal_cluster);
+  i32 start_w = start_bounds.max.x - start_bounds.min.x + 1;
+  i32 goal_w = goal_bounds.max.x - goal_bounds.min.x + 1;
+
+  mem_scratch_scope(scratch, 0) {
+    // start and goal join the graph for this search only, through their distances inside their clusters.
+    f32* start_dist = mem_array(f32, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    f32* goal_dist = mem_array(f32, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    u8* dir = mem_array(u8, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+    u8* moves = mem_array(u8, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+    mem_scope(scratch) {
+      hpa__moves(hpa, start_bounds, moves);
+      hpa__dijkstra(start_bounds, moves, start, start_dist, dir, 0, 0, scratch);
+    }
+
+    if (start_cluster == goal_cluster && start_dist[(goal.x - start_bounds.min.x) + (goal.y - start_bounds.min.y) * start_w] < FLOW_UNREACHABLE) {
+      direct = 1;
+    } else {
+      mem_scope(scratch) {
+        hpa__moves(hpa, goal_bounds, moves);
+        hpa__dijkstra(goal_bounds, moves, goal, goal_dist, dir, 0, 0, scratch);
+      }
+
+      if (++hpa->generation == 0) {
+        memset(hpa->records, 0, (goal_id + 1) * sizeof (hpa_record));
+        hpa->generation = 1;
+      }
+
+      u32 queue_cap = 1024;
+      path_queue queue = {0};
+      queue.buf = mem_array(path_node, queue_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+      hpa__relax(hpa, &queue, &queue_cap, scratch, start_id, start_id, 0, start, goal);
+
+      while (!path_queue_empty(&queue)) {
+        u32 id = (u32)path_queue_pop(&queue).x;
+        hpa_record* record = &hpa->records[id];
+        if (record->closed) continue;
+        record->closed = 1;
+
+        if (id == goal_id) {
+          // entrances in a cluster corner share a cell, they only show up once.
+          count = 1;
+          for (u32 it = id; it != start_id; it = hpa->records[it].parent) {
+            v2i a = hpa__id_pos(hpa, it, start, goal);
+            v2i b = hpa__id_pos(hpa, hpa->records[it].parent, start, goal);
+            count += a.x != b.x || a.y != b.y;
+          }
+          break;
+        }
+
+        f32 g = record->g;
+
+        if (id == start_id) {
+          hpa_cluster* cluster = &hpa->clusters[start_cluster];
+          for (u32 s = 0; s < HPA_CLUSTER_NODES; ++s) {
+            if (!hpa__valid_slot(cluster, s)) continue;
+            v2i pos = hpa__node_pos(hpa, start_cluster, s);
+            f32 d = start_dist[(pos.x - start_bounds.min.x) + (pos.y - start_bounds.min.y) * start_w];
+            if (d < FLOW_UNREACHABLE) {
+              hpa__relax(hpa, &queue, &queue_cap, scratch, start_cluster * HPA_CLUSTER_NODES + s, id, g + d, pos, goal);
+            }
+          }
+          continue;
+        }
+
+        u32 c = id / HPA_CLUSTER_NODES;
+        u32 s = id % HPA_CLUSTER_NODES;
+        hpa_cluster* cluster = &hpa->clusters[c];
+        const f32* cost = hpa->costs + cluster->cost_offset + hpa__entrance(cluster, s) * cluster->cost_count;
+
+        for (u32 border = 0; border < 4; ++border) {
+          for (u32 i = 0; i < cluster->border_count[border]; ++i) {
+            f32 d = *cost++;
+            if (d < FLOW_UNREACHABLE) {
+              u32 t = border * HPA_BORDER_NODES + i;
+              hpa__relax(hpa, &queue, &queue_cap, scratch, c * HPA_CLUSTER_NODES + t, id, g + d, hpa__node_pos(hpa, c, t), goal);
+            }
+          }
+        }
+
+        // the partner across the border has the same index on the opposite border.
+        u32 border = s / HPA_BORDER_NODES;
+        i32 cx = (i32)(c % (u32)hpa->clusters_x) + (border == 0) - (border == 2);
+        i32 cy = (i32)(c / (u32)hpa->clusters_x) + (border == 1) - (border == 3);
+        u32 other = (u32)(cx + cy * hpa->clusters_x);
+        u32 other_slot = ((border + 2) & 3) * HPA_BORDER_NODES + s % HPA_BORDER_NODES;
+        hpa__relax(hpa, &queue, &queue_cap, scratch, other * HPA_CLUSTER_NODES + other_slot, id, g + 1.0f, hpa__node_pos(hpa, other, other_slot), goal);
+
+        if (c == goal_cluster) {
+          v2i pos = hpa__node_pos(hpa, c, s);
+          f32 d = goal_dist[(pos.x - goal_bounds.min.x) + (pos.y - goal_bounds.min.y) * goal_w];
+          if (d < FLOW_UNREACHABLE) {
+            hpa__relax(hpa, &queue, &queue_cap, scratch, goal_id, id, g + d, goal, goal);
+          }
+        }
+      }
+    }
+  }
+
+  if (direct) {
+    if (out_max > 0) out[0] = start;
+    if (out_max > 1) out[1] = goal;
+    return 2;
+  }
+
+  u32 index = count;
+  v2i last = { -1, -1 };
+  for (u32 id = goal_id; index; id = hpa->records[id].parent) {
+    v2i pos = hpa__id_pos(hpa, id, start, goal);
+    if (pos.x == last.x && pos.y == last.y) continue;
+    if (--index < out_max) out[index] = pos;
+    last = pos;
+  }
+  return count;
+}
+
+ATS_API u32 hpa_refine(hpa_map* hpa, v2i from, v2i to, v2i* out, u32 out_max) {
+  // an entrance and its partner are next to each other.
+  if (abs(to.x - from.x) + abs(to.y - from.y) <= 1) {
+    u32 count = (from.x == to.x && from.y == to.y)? 1 : 2;
+    if (out_max > 0) out[0] = from;
+    if (out_max > 1 && count > 1) out[1] = to;
+    return count;
+  }
+
+  u32 cluster = hpa__cluster_of(hpa, from);
+  if (cluster != hpa__cluster_of(hpa, to)) return 0;
+
+  r2i bounds = hpa__bounds(hpa, cluster);
+  i32 w = bounds.max.x - bounds.min.x + 1;
+  u32 count = 0;
+
+  mem_scratch_scope(scratch, 0) {
+    f32* dist = mem_array(f32, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    u8* dir = mem_array(u8, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+    // searching from 'to' lets the path be read front to back by following dir from 'from'.
+    mem_scope(scratch) {
+      u8* targets = mem_array(u8, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch);
+      u8* moves = mem_array(u8, HPA_CLUSTER_SIZE * HPA_CLUSTER_SIZE, scratch, .flags = MEM_ALLOC_NO_ZERO);
+      targets[(from.x - bounds.min.x) + (from.y - bounds.min.y) * w] = 1;
+      hpa__moves(hpa, bounds, moves);
+      hpa__dijkstra(bounds, moves, to, dist, dir, targets, 1, scratch);
+    }
+
+    if (dist[(from.x - bounds.min.x) + (from.y - bounds.min.y) * w] < FLOW_UNREACHABLE) {
+      v2i pos = from;
+      for (;;) {
+        if (count < out_max) out[count] = pos;
+        count++;
+
+        u8 d = dir[(pos.x - bounds.min.x) + (pos.y - bounds.min.y) * w];
+        if (d == FLOW_DIR_NONE) break;
+        pos.x += flow__dx[d];
+        pos.y += flow__dy[d];
+      }
+    }
+  }
+  return count;
+}
+
+// =================================================== SPATIAL MAP =================================================== //
+
+static void sm__init(spatial_map* map) {
+  if (map->table_mod) return;
+
+  if (!map->cell_size) map->cell_size = 1.0f;
+
+  map->inv_cell_size = 1.0f / map->cell_size;
+  map->table_mod = SPATIAL_TABLE_MOD;
+}
+
+// 'table' stays null until the first growth, so a copy of the map doesn't point into the original.
+static sm_node** sm__table(spatial_map* map) {
+  return map->table? map->table : map->inline_table;
+}
+
+static void sm__grow(spatial_map* map) {
+  u32 old_size = map->table_mod + 1;
+  sm_node** old_table = sm__table(map);
+
+  map->table_mod = 2 * old_size - 1;
+  map->table = mem_array(sm_node*, 2 * old_size, map->arena);
+
+  for (u32 i = 0; i < old_size; ++i) {
+    sm_node* it = old_table[i];
+    while (it) {
+      sm_node* next = it->next;
+      u32 index = sm_index(map, it->x, it->y);
+      it->next = sm__table(map)[index];
+      sm__table(map)[index] = it;
+      it = next;
+    }
+  }
+}
+
+static void sm__check_load(spatial_map* map) {
+  if (map->arena && map->count > SPATIAL_LOAD_FACTOR * (map->table_mod + 1)) {
+    sm__grow(map);
+  }
+}
+
+ATS_API void sm_init(spatial_map* map, mem_arena* arena, f32 cell_size) {
+  memset(map, 0, sizeof *map);
+  map->arena = arena;
+  map->cell_size = cell_size;
+  sm__init(map);
+}
+
+ATS_API void sm_clear(spatial_map* map) {
+  sm__init(map);
+
+  sm_node** table = sm__table(map);
+
+  // nodes from the map's own arena are recycled, nodes from the arena stack may be gone already.
+  if (map->arena) {
+    for (u32 i = 0; i <= map->table_mod; ++i) {
+      sm_node* it = table[i];
+      while (it) {
+        sm_node* next = it->next;
+        it->next = map->free;
+        map->free = it;
+        it = next;
+      }
+    }
+  } else {
+    map->free = 0;
+  }
+
+  memset(table, 0, (map->table_mod + 1) * sizeof (sm_node*));
+  map->count = 0;
+}
+
+ATS_API u32 sm_index(spatial_map* map, i32 x, i32 y) {
+  sm__init(map);
+  u32 hash = hash2i(x, y);
+  return hash & map->table_mod;
+}
+
+ATS_API sm_node* sm_get(spatial_map* map, i32 x, i32 y) {
+  u32 index = sm_index(map, x, y);
+  return sm__table(map)[index];
+}
+
+static r2i sm__cells(spatial_map* map, r2 rect) {
+  r2i result = {
+    { (i32)floorf(rect.min.x * map->inv_cell_size), (i32)floorf(rect.min.y * map->inv_cell_size) },
+    { (i32)floorf(rect.max.x * map->inv_cell_size), (i32)floorf(rect.max.y * map->inv_cell_size) },
+  };
+  return result;
+}
+
+static void sm__insert(spatial_map* map, void* e, r2 e_rect, i32 x, i32 y) {
+  sm_node* node = map->free;
+  if (node) {
+    map->free = node->next;
+  } else {
+    node = mem_type(sm_node, map->arena, .flags = MEM_ALLOC_NO_HEADER | MEM_ALLOC_NO_ZERO);
+  }
+
+  u32 index = sm_index(map, x, y);
+  node->e = e;
+  node->rect = e_rect;
+  node->x = x;
+  node->y = y;
+  node->next = sm__table(map)[index];
+  sm__table(map)[index] = node;
+  map->count++;
+}
+
+// returns the node of 'e' in cell (x, y), 'unlink' moves it to the free list.
+static sm_node* sm__find(spatial_map* map, void* e, i32 x, i32 y, b32 unlink) {
+  sm_node** it = &sm__table(map)[sm_index(map, x, y)];
+  while (*it && ((*it)->e != e || (*it)->x != x || (*it)->y != y)) {
+    it = &(*it)->next;
+  }
+
+  sm_node* node = *it;
+  if (node && unlink) {
+    *it = node->next;
+    node->next = map->free;
+    map->free = node;
+    map->count--;
+  }
+  return node;
+}
+
+ATS_API void sm_add(spatial_map* map, void* e, r2 e_rect) {
+  sm__init(map);
+
+  r2i rect = sm__cells(map, e_rect);
+  for_r2(rect, x, y) {
+    sm__insert(map, e, e_rect, x, y);
+  }
+
+  sm__check_load(map);
+}
+
+ATS_API void sm_remove(spatial_map* map, void* e, r2 e_rect) {
+  sm__init(map);
+
+  r2i rect = sm__cells(map, e_rect);
+  for_r2(rect, x, y) {
+    sm__find(map, e, x, y, 1);
+  }
+}
+
+ATS_API void sm_move(spatial_map* map, void* e, r2 old_rect, r2 new_rect) {
+  sm__init(map);
+
+  r2i old_cells = sm__cells(map, old_rect);
+  r2i new_cells = sm__cells(map, new_rect);
+
+  // cells in both only need the new rect, the rest are unlinked / linked.
+  for_r2(old_cells, x, y) {
+    b32 keep = r2i_contains(new_cells, v2i(x, y));
+    sm_node* node = sm__find(map, e, x, y, !keep);
+    if (keep && node) node->rect = new_rect;
+  }
+
+  for_r2(new_cells, x, y) {
+    if (!r2i_contains(old_cells, v2i(x, y))) {
+      sm__insert(map, e, new_rect, x, y);
+    }
+  }
+
+  sm__check_load(map);
+}
+
+// an entity covering several queried cells is only reported from the first cell where
+// it overlaps the query, so results are unique without having to look at earlier hits.
+static b32 sm__is_first_hit(spatial_map* map, sm_node* node, r2i query, i32 x, i32 y) {
+  if (node->x != x || node->y != y) return 0; // hash collision with another cell
+
+  r2i cells = sm__cells(map, node->rect);
+  return x == max(cells.min.x, query.min.x) && y == max(cells.min.y, query.min.y);
+}
+
+ATS_API u32 sm_query(spatial_map* map, v2 pos, v2 rad, void* ignore, void** out, u32 out_max) {
+  u32 count = 0;
+
+  r2 rect = {
+    { pos.x - rad.x, pos.y - rad.y },
+    { pos.x + rad.x, pos.y + rad.y },
+  };
+
+  sm__init(map);
+
+  r2i irect = sm__cells(map, rect);
+
+  for_r2(irect, x, y) {
+    u32 index = sm_index(map, x, y);
+
+    for (sm_node* it = sm__table(map)[index]; it; it = it->next) {
+      if ((it->e == ignore) || !sm__is_first_hit(map, it, irect, x, y) || !r2_intersect(rect, it->rect)) continue;
+
+      if (count >= out_max) return count;
+      out[count++] = it->e;
+    }
+  }
+  return count;
+}
+
+ATS_API sm_node* sm_in_range(spatial_map* map, v2 pos, v2 rad, void* ignore) {
+  sm_node* result = 0;
+
+  r2 rect = {
+    { pos.x - rad.x, pos.y - rad.y },
+    { pos.x + rad.x, pos.y + rad.y },
+  };
+
+  sm__init(map);
+
+  r2i irect = sm__cells(map, rect);
+
+  for_r2(irect, x, y) {
+    u32 index = sm_index(map, x, y);
+
+    for (sm_node* it = sm__table(map)[index]; it; it = it->next) {
+      if ((it->e == ignore) || !sm__is_first_hit(map, it, irect, x, y) || !r2_intersect(rect, it->rect)) continue;
+
+      sm_node* n = mem_type(sm_node, .flags = MEM_ALLOC_NO_HEADER | MEM_ALLOC_NO_ZERO);
+      *n = *it;
+      n->next = result;
+      result = n;
+    }
+  }
+  return result;
+}
+
+ATS_API void* sm_get_closest(spatial_map* map, v2 pos, f32 range, void* ignore, b32 (*condition_proc)(void*)) {
+  void* result = 0;
+  f32 distance_sq = range * range;
+
+  r2 rect = {
+    { pos.x - range, pos.y - range },
+    { pos.x + range, pos.y + range },
+  };
+
+  sm__init(map);
+
+  r2i irect = sm__cells(map, rect);
+
+  for_r2(irect, x, y) {
+    u32 index = sm_index(map, x, y);
+
+    for (sm_node* it = sm__table(map)[index]; it; it = it->next) {
+      if ((it->e == ignore) || !sm__is_first_hit(map, it, irect, x, y) || !r2_intersect(rect, it->rect)) continue;
+      if (condition_proc && !condition_proc(it->e)) continue;
+
+      v2 e_pos = {
+        0.5f * (it->rect.min.x + it->rect.max.x),
+        0.5f * (it->rect.min.y + it->rect.max.y),
+      };
+
+      f32 new_distance_sq = v2_dist_sq(e_pos, pos);
+
+      if (new_distance_sq <= distance_sq) {
+        result = it->e;
+        distance_sq = new_distance_sq;
+      }
+    }
+  }
+
+  return result;
+}
+
+// max heap on dist_sq, the root is the worst of the k best so far.
+static void sm__heap_push(sm_neighbor* heap, u32* count, u32 k, sm_neighbor n) {
+  u32 i = 0;
+  if (*count < k) {
+    i = (*count)++;
+    while (i > 0 && heap[(i - 1) / 2].dist_sq < n.dist_sq) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+  } else {
+    if (n.dist_sq >= heap[0].dist_sq) return;
+    for (;;) {
+      u32 j = 2 * i + 1;
+      if (j >= *count) break;
+      if (j + 1 < *count && heap[j + 1].dist_sq > heap[j].dist_sq) j++;
+      if (heap[j].dist_sq <= n.dist_sq) break;
+      heap[i] = heap[j];
+      i = j;
+    }
+  }
+  heap[i] = n;
+}
+
+// in place heap sort, leaves the closest first.
+static void sm__heap_sort(sm_neighbor* heap, u32 count) {
+  while (count > 1) {
+    sm_neighbor top = heap[0];
+    sm_neighbor last = heap[--count];
+    u32 i = 0;
+    for (;;) {
+      u32 j = 2 * i + 1;
+      if (j >= count) break;
+      if (j + 1 < count && heap[j + 1].dist_sq > heap[j].dist_sq) j++;
+      if (heap[j].dist_sq <= last.dist_sq) break;
+      heap[i] = heap[j];
+      i = j;
+    }
+    heap[i] = last;
+    heap[count] = top;
+  }
+}
+
+static v2 sm__center(r2 rect) {
+  return v2(0.5f * (rect.min.x + rect.max.x), 0.5f * (rect.min.y + rect.max.y));
+}
+
+// every entity has exactly one node in the cell holding its center, only that one is looked at.
+static b32 sm__is_center_node(spatial_map* map, sm_node* node, i32 x, i32 y, v2* center) {
+  if (node->x != x || node->y != y) return 0;
+  *center = sm__center(node->rect);
+  return (i32)floorf(center->x * map->inv_cell_size) == x && (i32)floorf(center->y * map->inv_cell_size) == y;
+}
+
+ATS_API u32 sm_knn(spatial_map* map, v2 pos, f32 range, u32 k, void* ignore, sm_neighbor* out) {
+  u32 count = 0;
+  f32 range_sq = range * range;
+
+  if (!k) return 0;
+  sm__init(map);
+
+  f32 cell = map->cell_size;
+  i32 cx = (i32)floorf(pos.x * map->inv_cell_size);
+  i32 cy = (i32)floorf(pos.y * map->inv_cell_size);
+
+  // distance from pos to the closest edge of its own cell.
+  f32 edge = min(min(pos.x - cx * cell, (cx + 1) * cell - pos.x), min(pos.y - cy * cell, (cy + 1) * cell - pos.y));
+
+  for (i32 ring = 0;; ++ring) {
+    // nothing in this ring or further out can be closer than this.
+    f32 bound = ring? edge + (ring - 1) * cell : 0;
+    if (bound > range) break;
+    if (count == k && bound * bound >= out[0].dist_sq) break;
+
+    r2i rect = { { cx - ring, cy - ring }, { cx + ring, cy + ring } };
+    for_r2(rect, x, y) {
+      if (ring && x != rect.min.x && x != rect.max.x && y != rect.min.y && y != rect.max.y) {
+        x = rect.max.x - 1; // skip the inside, it was done by earlier rings
+        continue;
+      }
+      for (sm_node* it = sm_get(map, x, y); it; it = it->next) {
+        v2 center;
+        if (it->e == ignore || !sm__is_center_node(map, it, x, y, &center)) continue;
+
+        f32 dist_sq = v2_dist_sq(center, pos);
+        if (dist_sq <= range_sq) {
+          sm__heap_push(out, &count, k, (sm_neighbor) { it->e, dist_sq });
+        }
+      }
+    }
+  }
+
+  sm__heap_sort(out, count);
+  return count;
+}
+
+typedef struct {
+  i32 tile_x;
+  i32 tile_y;
+  u32 index;
+} sm__knn_query;
+
+static int sm__knn_query_cmp(const void* va, const void* vb) {
+  const sm__knn_query* a = va;
+  const sm__knn_query* b = vb;
+  if (a->tile_y != b->tile_y) return a->tile_y < b->tile_y? -1 : 1;
+  if (a->tile_x != b->tile_x) return a->tile_x < b->tile_x? -1 : 1;
+  return a->index < b->index? -1 : a->index > b->index;
+}
+
+ATS_API void sm_knn_batch(spatial_map* map, const v2* pos, void** ignore, u32 count, f32 range, u32 k, sm_neighbor* out, u32* out_count) {
+  if (!count) return;
+  sm__init(map);
+
+  // cells a query can reach past its own, plus one so rounding never puts a cell outside its tile.
+  f32 reach_cells = ceilf(range * map->inv_cell_size) + 1;
+  i32 reach = reach_cells < SPATIAL_KNN_BATCH_CELLS? (i32)reach_cells : SPATIAL_KNN_BATCH_CELLS;
+  i32 width = SPATIAL_KNN_TILE + 2 * reach;
+
+  // a range this wide gathers more cells per tile than the rings of sm_knn would look at.
+  if (width * width > SPATIAL_KNN_BATCH_CELLS) {
+    for (u32 i = 0; i < count; ++i) {
+      out_count[i] = sm_knn(map, pos[i], range, k, ignore? ignore[i] : 0, out + (usize)i * k);
+    }
+    return;
+  }
+
+  f32 range_sq = range * range;
+  f32 inv_tile_size = map->inv_cell_size / SPATIAL_KNN_TILE;
+
+  mem_scratch_scope(scratch, 0) {
+    // queries are grouped by tile, and each tile buckets only the cells its queries can reach,
+    // so queries far apart never make a table over the space between them.
+    sm__knn_query* query = mem_array(sm__knn_query, count, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    for (u32 i = 0; i < count; ++i) {
+      query[i].tile_x = (i32)floorf(pos[i].x * inv_tile_size);
+      query[i].tile_y = (i32)floorf(pos[i].y * inv_tile_size);
+      query[i].index = i;
+    }
+    sort(query, count, sm__knn_query_cmp);
+
+    u32 candidate_cap = 1024;
+    void** candidate = mem_array(void*, candidate_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    v2* center = mem_array(v2, candidate_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    u32* cell_start = mem_array(u32, (usize)width * width + 1, scratch, .flags = MEM_ALLOC_NO_ZERO);
+
+    for (u32 first = 0, last = 0; first < count; first = last) {
+      while (last < count && query[last].tile_x == query[first].tile_x && query[last].tile_y == query[first].tile_y) last++;
+
+      // a lone query is cheaper to answer with the rings of sm_knn than by gathering its whole tile.
+      if (last - first == 1) {
+        u32 i = query[first].index;
+        out_count[i] = sm_knn(map, pos[i], range, k, ignore? ignore[i] : 0, out + (usize)i * k);
+        continue;
+      }
+
+      r2i cells = {
+        { query[first].tile_x * SPATIAL_KNN_TILE - reach, query[first].tile_y * SPATIAL_KNN_TILE - reach },
+        { query[first].tile_x * SPATIAL_KNN_TILE + SPATIAL_KNN_TILE - 1 + reach, query[first].tile_y * SPATIAL_KNN_TILE + SPATIAL_KNN_TILE - 1 + reach },
+      };
+
+      // gather every candidate of the tile once. cells are walked in order, so the candidates come out
+      // bucketed by cell and 'cell_start' only has to remember where each one begins.
+      u32 candidate_count = 0;
+      u32 cell_index = 0;
+      for_r2(cells, x, y) {
+        cell_start[cell_index++] = candidate_count;
+
+        for (sm_node* it = sm_get(map, x, y); it; it = it->next) {
+          v2 c;
+          if (!sm__is_center_node(map, it, x, y, &c)) continue;
+
+          if (candidate_count == candidate_cap) {
+            void** new_candidate = mem_array(void*, 2 * candidate_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+            v2* new_center = mem_array(v2, 2 * candidate_cap, scratch, .flags = MEM_ALLOC_NO_ZERO);
+            memcpy(new_candidate, candidate, candidate_count * sizeof *candidate);
+            memcpy(new_center, center, candidate_count * sizeof *center);
+            candidate = new_candidate;
+            center = new_center;
+            candidate_cap *= 2;
+          }
+
+          candidate[candidate_count] = it->e;
+          center[candidate_count] = c;
+          candidate_count++;
+        }
+      }
+      cell_start[cell_index] = candidate_count;
+
+      for (u32 q = first; q < last; ++q) {
+        u32 i = query[q].index;
+        sm_neighbor* heap = out + (usize)i * k;
+        void* skip = ignore? ignore[i] : 0;
+        u32 n = 0;
+
+        // only the cells within range of this query, every row of them is one run of candidates.
+        r2i rect = sm__cells(map, r2(v2_sub(pos[i], v2(range, range)), v2_add(pos[i], v2(range, range))));
+        i32 x0 = max(rect.min.x, cells.min.x) - cells.min.x;
+        i32 x1 = min(rect.max.x, cells.max.x) - cells.min.x;
+        i32 y0 = max(rect.min.y, cells.min.y) - cells.min.y;
+        i32 y1 = min(rect.max.y, cells.max.y) - cells.min.y;
+
+        for (i32 y = y0; y <= y1 && k; ++y) {
+          u32 end = cell_start[y * width + x1 + 1];
+
+          for (u32 j = cell_start[y * width + x0]; j < end; ++j) {
+            f32 dist_sq = v2_dist_sq(center[j], pos[i]);
+            if (dist_sq <= range_sq && candidate[j] != skip) {
+              sm__heap_push(heap, &n, k, (sm_neighbor) { candidate[j], dist_sq });
+            }
+          }
+        }
+
+        sm__heap_sort(heap, n);
+        out_count[i] = n;
+      }
+    }
+  }
+}
+
+ATS_API void* sm_at_position(spatial_map* map, v2 pos) {
+  sm__init(map);
+
+  i32 x = (i32)floorf(pos.x * map->inv_cell_size);
+  i32 y = (i32)floorf(pos.y * map->inv_cell_size);
+
+  for (sm_node* it = sm_get(map, x, y); it; it = it->next) {
+    if (it->x == x && it->y == y && r2_contains(it->rect, pos)) {
+      return it->e;
+    }
+  }
+  return 0;
+}
+
+// =================================================== SPATIAL MAP 3D =================================================== //
+
+static void sm3__init(spatial_map3* map) {
+  if (map->table_mod) return;
+
+  if (!map->cell_size) map->cell_size = 1.0f;
+
+  map->inv_cell_size = 1.0f / map->cell_size;
+  map->table_mod = SPATIAL_TABLE_MOD;
+}
+
+static sm3_node** sm3__table(spatial_map3* map) {
+  return map->table? map->table : map->inline_table;
+}
+
+static void sm3__grow(spatial_map3* map) {
+  u32 old_size = map->table_mod + 1;
+  sm3_node** old_table = sm3__table(map);
+
+  map->table_mod = 2 * old_size - 1;
+  map->table = mem_array(sm3_node*, 2 * old_size, map->arena);
+
+  for (u32 i = 0; i < old_size; ++i) {
+    sm3_node* it = old_table[i];
+    while (it) {
+      sm3_node* next = it->next;
+      u32 index = sm3_index(map, it->x, it->y, it->z);
+      it->next = sm3__table(map)[index];
+      sm3__table(map)[index] = it;
+      it = next;
+    }
+  }
+}
+
+static void sm3__check_load(spatial_map3* map) {
+  if (map->arena && map->count > SPATIAL_LOAD_FACTOR * (map->table_mod + 1)) {
+    sm3__grow(map);
+  }
+}
+
+ATS_API void sm3_init(spatial_map3* map, mem_arena* arena, f32 cell_size) {
+  memset(map, 0, sizeof *map);
+  map->arena = arena;
+  map->cell_size = cell_size;
+  sm3__init(map);
+}
+
+ATS_API void sm3_clear(spatial_map3* map) {
+  sm3__init(map);
+
+  sm3_node** table = sm3__table(map);
+
+  // same as sm_clear, only nodes from the map's own arena are recycled.
+  if (map->arena) {
+    for (u32 i = 0; i <= map->table_mod; ++i) {
+      sm3_node* it = table[i];
+      while (it) {
+        sm3_node* next = it->next;
+        it->next = map->free;
+        map->free = it;
+        it = next;
+      }
+    }
+  } else {
+    map->free = 0;
+  }
+
+  memset(table, 0, (map->table_mod + 1) * sizeof (sm3_node*));
+  map->count = 0;
+}
+
+ATS_API u32 sm3_index(spatial_map3* map, i32 x, i32 y, i32 z) {
+  sm3__init(map);
+  u32 hash = hash3i(x, y, z);
+  return hash & map->table_mod;
+}
+
+ATS_API sm3_node* sm3_get(spatial_map3* map, i32 x, i32 y, i32 z) {
+  u32 index = sm3_index(map, x, y, z);
+  return sm3__table(map)[index];
+}
+
+static r3i sm3__cells(spatial_map3* map, r3 rect) {
+  f32 inv = map->inv_cell_size;
+  r3i result = {
+    { (i32)floorf(rect.min.x * inv), (i32)floorf(rect.min.y * inv), (i32)floorf(rect.min.z * inv) },
+    { (i32)floorf(rect.max.x * inv), (i32)floorf(rect.max.y * inv), (i32)floorf(rect.max.z * inv) },
+  };
+  return result;
+}
+
+static void sm3__insert(spatial_map3* map, void* e, r3 e_rect, i32 x, i32 y, i32 z) {
+  sm3_node* node = map->free;
+  if (node) {
+    map->free = node->next;
+  } else {
+    node = mem_type(sm3_node, map->arena, .flags = MEM_ALLOC_NO_HEADER | MEM_ALLOC_NO_ZERO);
+  }
+
+  u32 index = sm3_index(map, x, y, z);
+  node->e = e;
+  node->rect = e_rect;
+  node->x = x;
+  node->y = y;
+  node->z = z;
+  node->next = sm3__table(map)[index];
+  sm3__table(map)[index] = node;
+  map->count++;
+}
+
+static sm3_node* sm3__find(spatial_map3* map, void* e, i32 x, i32 y, i32 z, b32 unlink) {
+  sm3_node** it = &sm3__table(map)[sm3_index(map, x, y, z)];
+  while (*it && ((*it)->e != e || (*it)->x != x || (*it)->y != y || (*it)->z != z)) {
+    it = &(*it)->next;
+  }
+
+  sm3_node* node = *it;
+  if (node && unlink) {
+    *it = node->next;
+    node->next = map->free;
+    map->free = node;
+    map->count--;
+  }
+  return node;
+}
+
+ATS_API void sm3_add(spatial_map3* map, void* e, r3 e_rect) {
+  sm3__init(map);
+
+  r3i rect = sm3__cells(map, e_rect);
+  for_r3(rect, x, y, z) {
+    sm3__insert(map, e, e_rect, x, y, z);
+  }
+
+  sm3__check_load(map);
+}
+
+ATS_API void sm3_remove(spatial_map3* map, void* e, r3 e_rect) {
+  sm3__init(map);
+
+  r3i rect = sm3__cells(map, e_rect);
+  for_r3(rect, x, y, z) {
+    sm3__find(map, e, x, y, z, 1);
+  }
+}
+
+ATS_API void sm3_move(spatial_map3* map, void* e, r3 old_rect, r3 new_rect) {
+  sm3__init(map);
+
+  r3i old_cells = sm3__cells(map, old_rect);
+  r3i new_cells = sm3__cells(map, new_rect);
+
+  for_r3(old_cells, x, y, z) {
+    b32 keep = r3i_contains(new_cells, v3i(x, y, z));
+    sm3_node* node = sm3__find(map, e, x, y, z, !keep);
+    if (keep && node) node->rect = new_rect;
+  }
+
+  for_r3(new_cells, x, y, z) {
+    if (!r3i_contains(old_cells, v3i(x, y, z))) {
+      sm3__insert(map, e, new_rect, x, y, z);
+    }
+  }
+
+  sm3__check_load(map);
+}
+
+// same rule as sm__is_first_hit, with the third axis.
+static b32 sm3__is_first_hit(spatial_map3* map, sm3_node* node, r3i query, i32 x, i32 y, i32 z) {
+  if (node->x != x || node->y != y || node->z != z) return 0;
+
+  r3i cells = sm3__cells(map, node->rect);
+  return
+    x == max(cells.min.x, query.min.x) &&
+    y == max(cells.min.y, query.min.y) &&
+    z == max(cells.min.z, query.min.z);
+}
+
+ATS_API u32 sm3_query(spatial_map3* map, v3 pos, v3 rad, void* ignore, void** out, u32 out_max) {
+  u32 count = 0;
+
+  r3 rect = {
+    { pos.x - rad.x, pos.y - rad.y, pos.z - rad.z },
+    { pos.x + rad.x, pos.y + rad.y, pos.z + rad.z },
+  };
+
+  sm3__init(map);
+
+  r3i irect = sm3__cells(map, rect);
+
+  for_r3(irect, x, y, z) {
+    u32 index = sm3_index(map, x, y, z);
+
+    for (sm3_node* it = sm3__table(map)[index]; it; it = it->next) {
+      if ((it->e == ignore) || !sm3__is_first_hit(map, it, irect, x, y, z) || !r3_intersect(rect, it->rect)) continue;
+
+      if (count >= out_max) return count;
+      out[count++] = it->e;
+    }
+  }
+  return count;
+}
+
+ATS_API sm3_node* sm3_in_range(spatial_map3* map, v3 pos, v3 rad, void* ignore) {
+  sm3_node* result = 0;
+
+  r3 rect = {
+    { pos.x - rad.x, pos.y - rad.y, pos.z - rad.z },
+    { pos.x + rad.x, pos.y + rad.y, pos.z + rad.z },
+  };
+
+  sm3__init(map);
+
+  r3i irect = sm3__cells(map, rect);
+
+  for_r3(irect, x, y, z) {
+    u32 index = sm3_index(map, x, y, z);
+
+    for (sm3_node* it = sm3__table(map)[index]; it; it = it->next) {
+      if ((it->e == ignore) || !sm3__is_first_hit(map, it, irect, x, y, z) || !r3_intersect(rect, it->rect)) continue;
+
+      sm3_node* n = mem_type(sm3_node, .flags = MEM_ALLOC_NO_HEADER | MEM_ALLOC_NO_ZERO);
+      *n = *it;
+      n->next = result;
+      result = n;
+    }
+  }
+  return result;
+}
+
+static v3 sm3__center(r3 rect) {
+  return v3(0.5f * (rect.min.x + rect.max.x), 0.5f * (rect.min.y + rect.max.y), 0.5f * (rect.min.z + rect.max.z));
+}
+
+ATS_API void* sm3_get_closest(spatial_map3* map, v3 pos, f32 range, void* ignore, b32 (*condition_proc)(void*)) {
+  void* result = 0;
+  f32 distance_sq = range * range;
+
+  r3 rect = {
+    { pos.x - range, pos.y - range, pos.z - range },
+    { pos.x + range, pos.y + range, pos.z + range },
+  };
+
+  sm3__init(map);
+
+  r3i irect = sm3__cells(map, rect);
+
+  for_r3(irect, x, y, z) {
+    u32 index = sm3_index(map, x, y, z);
+
+    for (sm3_node* it = sm3__table(map)[index]; it; it = it->next) {
+      if ((it->e == ignore) || !sm3__is_first_hit(map, it, irect, x, y, z) || !r3_intersect(rect, it->rect)) continue;
+      if (condition_proc && !condition_proc(it->e)) continue;
+
+      f32 new_distance_sq = v3_dist_sq(sm3__center(it->rect), pos);
+
+      if (new_distance_sq <= distance_sq) {
+        result = it->e;
+        distance_sq = new_distance_sq;
+      }
+    }
+  }
+
+  return result;
+}
+
+static b32 sm3__is_center_node(spatial_map3* map, sm3_node* node, i32 x, i32 y, i32 z, v3* center) {
+  if (node->x != x || node->y != y || node->z != z) return 0;
+  *center = sm3__center(node->rect);
+  f32 inv = map->inv_cell_size;
+  return (i32)floorf(center->x * inv) == x && (i32)floorf(center->y * inv) == y && (i32)floorf(center->z * inv) == z;
+}
+
+ATS_API u32 sm3_knn(spatial_map3* map, v3 pos, f32 range, u32 k, void* ignore, sm_neighbor* out) {
+  u32 count = 0;
+  f32 range_sq = range * range;
+
+  if (!k) return 0;
+  sm3__init(map);
+
+  f32 cell = map->cell_size;
+  i32 cx = (i32)floorf(pos.x * map->inv_cell_size);
+  i32 cy = (i32)floorf(pos.y * map->inv_cell_size);
+  i32 cz = (i32)floorf(pos.z * map->inv_cell_size);
+
+  f32 edge = min(
+    min(min(pos.x - cx * cell, (cx + 1) * cell - pos.x), min(pos.y - cy * cell, (cy + 1) * cell - pos.y)),
+    min(pos.z - cz * cell, (cz + 1) * cell - pos.z));
+
+  // grows shell by shell, see sm_knn.
+  for (i32 ring = 0;; ++ring) {
+    f32 bound = ring? edge + (ring - 1) * cell : 0;
+    if (bound > range) break;
+    if (count == k && bound * bound >= out[0].dist_sq) break;
+
+    r3i rect = { { cx - ring, cy - ring, cz - ring }, { cx + ring, cy + ring, cz + ring } };
+    for_r3(rect, x, y, z) {
+      if (ring && x != rect.min.x && x != rect.max.x &&
+          y != rect.min.y && y != rect.max.y && z != rect.min.z && z != rect.max.z) {
+        x = rect.max.x - 1;
+        continue;
+      }
+      for (sm3_node* it = sm3_get(map, x, y, z); it; it = it->next) {
+        v3 center;
+        if (it->e == ignore || !sm3__is_center_node(map, it, x, y, z, &center)) continue;
+
+        f32 dist_sq = v3_dist_sq(center, pos);
+        if (dist_sq <= range_sq) {
+          sm__heap_push(out, &count, k, (sm_neighbor) { it->e, dist_sq });
+        }
+      }
+    }
+  }
+
+  sm__heap_sort(out, count);
+  return count;
+}
+
+ATS_API void* sm3_at_position(spatial_map3* map, v3 pos) {
+  sm3__init(map);
+
+  i32 x = (i32)floorf(pos.x * map->inv_cell_size);
+  i32 y = (i32)floorf(pos.y * map->inv_cell_size);
+  i32 z = (i32)floorf(pos.z * map->inv_cell_size);
+
+  for (sm3_node* it = sm3_get(map, x, y, z); it; it = it->next) {
+    if (it->x == x && it->y == y && it->z == z && r3_contains(it->rect, pos)) {
+      return it->e;
+    }
+  }
+  return 0;
+}
+
+// =================================================== SPATIAL GRID =================================================== //
+
+ATS_API spatial_grid sg_create(mem_arena* arena, u32 table_log2, f32 cell_size) {
+  spatial_grid grid = {0};
+  u32 table_size = 1u << def(table_log2, 12);
+
+  grid.arena = arena; // null allocates from the top of the arena stack
+  grid.cell_size = def(cell_size, 1.0f);
+  grid.inv_cell_size = 1.0f / grid.cell_size;
+  grid.table_mod = table_size - 1;
+  grid.cell_start = mem_array(u32, table_size + 1, grid.arena);
+
+  return grid;
+}
+
+ATS_API void sg_clear(spatial_grid* grid) {
+  grid->item_count = 0;
+  grid->entry_count = 0;
+  memset(grid->cell_start, 0, (grid->table_mod + 2) * sizeof (u32));
+}
+
+static r2i sg__cells(spatial_grid* grid, r2 rect) {
+  r2i result = {
+    { (i32)floorf(rect.min.x * grid->inv_cell_size), (i32)floorf(rect.min.y * grid->inv_cell_size) },
+    { (i32)floorf(rect.max.x * grid->inv_cell_size), (i32)floorf(rect.max.y * grid->inv_cell_size) },
+  };
+  return result;
+}
+
+static u32 sg__index(spatial_grid* grid, i32 x, i32 y) {
+  return hash2i(x, y) & grid->table_mod;
+}
+
+ATS_API void sg_add(spatial_grid* grid, void* e, r2 e_rect) {
+  if (grid->item_count == grid->item_cap) {
+    u32 cap = max(grid->item_cap << 1, 1024);
+    sg_item* items = mem_array(sg_item, cap, grid->arena, .flags = MEM_ALLOC_NO_ZERO);
+    if (grid->item_count) memcpy(items, grid->items, grid->item_count * sizeof (sg_item));
+    grid->items = items;
+    grid->stamps = mem_array(u32, cap, grid->arena);
+    grid->item_cap = cap;
+    grid->stamp = 0;
+  }
+
+  sg_item* item = &grid->items[grid->item_count++];
+  item->e = e;
+  item->rect = e_rect;
+
+  // count per bucket now, sg_build turns the counts into offsets.
+  r2i rect = sg__cells(grid, e_rect);
+  for_r2(rect, x, y) {
+    grid->cell_start[sg__index(grid, x, y)]++;
+    grid->entry_count++;
+  }
+}
+
+ATS_API void sg_build(spatial_grid* grid) {
+  if (grid->entry_count > grid->entry_cap) {
+    grid->entry_cap = max(grid->entry_count + (grid->entry_count >> 1), 1024);
+    grid->entries = mem_array(sg_entry, grid->entry_cap, grid->arena, .flags = MEM_ALLOC_NO_ZERO);
+  }
+
+  // inclusive prefix sum gives every bucket its end offset ...
+  u32 sum = 0;
+  for (u32 i = 0; i <= grid->table_mod; ++i) {
+    sum += grid->cell_start[i];
+    grid->cell_start[i] = sum;
+  }
+  grid->cell_start[grid->table_mod + 1] = sum;
+
+  // ... and filling backwards leaves it at its start offset.
+  for (u32 i = grid->item_count; i > 0; --i) {
+    sg_item* item = &grid->items[i - 1];
+    r2i rect = sg__cells(grid, item->rect);
+    for_r2(rect, x, y) {
+      sg_entry* entry = &grid->entries[--grid->cell_start[sg__index(grid, x, y)]];
+      entry->index = i - 1;
+      entry->rect = item->rect;
+    }
+  }
+}
+
+static u32 sg__next_stamp(spatial_grid* grid) {
+  if (++grid->stamp == 0) {
+    memset(grid->stamps, 0, grid->item_cap * sizeof (u32));
+    grid->stamp = 1;
+  }
+  return grid->stamp;
+}
+
+ATS_API u32 sg_in_range(spatial_grid* grid, v2 pos, v2 rad, void* ignore, void** out, u32 out_max) {
+  u32 count = 0;
+  u32 stamp = sg__next_stamp(grid);
+
+  r2 rect = {
+    { pos.x - rad.x, pos.y - rad.y },
+    { pos.x + rad.x, pos.y + rad.y },
+  };
+
+  r2i irect = sg__cells(grid, rect);
+
+  for_r2(irect, x, y) {
+    u32 index = sg__index(grid, x, y);
+    u32 end = grid->cell_start[index + 1];
+
+    for (u32 i = grid->cell_start[index]; i < end; ++i) {
+      sg_entry* entry = &grid->entries[i];
+      if (grid->stamps[entry->index] == stamp || !r2_intersect(rect, entry->rect)) continue;
+
+      grid->stamps[entry->index] = stamp;
+
+      void* e = grid->items[entry->index].e;
+      if (e == ignore) continue;
+
+      if (count >= out_max) return count;
+      out[count++] = e;
+    }
+  }
+  return count;
+}
+
+ATS_API void* sg_get_closest(spatial_grid* grid, v2 pos, f32 range, void* ignore, b32 (*condition_proc)(void*)) {
+  void* result = 0;
+  f32 distance_sq = range * range;
+  u32 stamp = sg__next_stamp(grid);
+
+  r2 rect = {
+    { pos.x - range, pos.y - range },
+    { pos.x + range, pos.y + range },
+  };
+
+  r2i irect = sg__cells(grid, rect);
+
+  for_r2(irect, x, y) {
+    u32 index = sg__index(grid, x, y);
+    u32 end = grid->cell_start[index + 1];
+
+    for (u32 i = grid->cell_start[index]; i < end; ++i) {
+      sg_entry* entry = &grid->entries[i];
+      if (grid->stamps[entry->index] == stamp || !r2_intersect(rect, entry->rect)) continue;
+
+      grid->stamps[entry->index] = stamp;
+
+      void* e = grid->items[entry->index].e;
+      if (e == ignore || (condition_proc && !condition_proc(e))) continue;
+
+      v2 e_pos = {
+        0.5f * (entry->rect.min.x + entry->rect.max.x),
+        0.5f * (entry->rect.min.y + entry->rect.max.y),
+      };
+
+      f32 new_distance_sq = v2_dist_sq(e_pos, pos);
+
+      if (new_distance_sq <= distance_sq) {
+        result = e;
+        distance_sq = new_distance_sq;
+      }
+    }
+  }
+  return result;
+}
+
+ATS_API void* sg_at_position(spatial_grid* grid, v2 pos) {
+  u32 index = sg__index(grid, (i32)floorf(pos.x * grid->inv_cell_size), (i32)floorf(pos.y * grid->inv_cell_size));
+  u32 end = grid->cell_start[index + 1];
+  for (u32 i = grid->cell_start[index]; i < end; ++i) {
+    sg_entry* entry = &grid->entries[i];
+    if (r2_contains(entry->rect, pos)) {
+      return grid->items[entry->index].e;
+    }
+  }
+  return 0;
+}
+
+// ================================================= AABB TREE ================================================= //
+
+static r3 bvh__union(r3 a, r3 b) {
+  r3 result = {
+    { min(a.min.x, b.min.x), min(a.min.y, b.min.y), min(a.min.z, b.min.z) },
+    { max(a.max.x, b.max.x), max(a.max.y, b.max.y), max(a.max.z, b.max.z) },
+  };
+  return result;
+}
+
+// sum of the extents instead of the surface area, so flat boxes from r2 rects still get a useful cost.
+static f32 bvh__cost(r3 a) {
+  return (a.max.x - a.min.x) + (a.max.y - a.min.y) + (a.max.z - a.min.z);
+}
+
+static b32 bvh__encloses(r3 outer, r3 inner) {
+  return
+    outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+    outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+static r3 bvh__fatten(bvh_tree* tree, r3 box) {
+  f32 m = tree->margin;
+  r3 result = {
+    { box.min.x - m, box.min.y - m, box.min.z - m },
+    { box.max.x + m, box.max.y + m, box.max.z + m },
+  };
+  return result;
+}
+
+ATS_API bvh_tree bvh_create(mem_arena* arena, f32 margin) {
+  bvh_tree tree = {0};
+
+  tree.arena = arena; // null allocates from the top of the arena stack
+  tree.margin = margin;
+  tree.root = BVH_NULL;
+  tree.free = BVH_NULL;
+
+  return tree;
+}
+
+ATS_API void bvh_clear(bvh_tree* tree) {
+  tree->root = BVH_NULL;
+  tree->free = BVH_NULL;
+  tree->count = 0;
+  tree->node_count = 0;
+}
+
+static u32 bvh__alloc_node(bvh_tree* tree) {
+  if (tree->free != BVH_NULL) {
+    u32 id = tree->free;
+    tree->free = tree->nodes[id].parent;
+    return id;
+  }
+
+  if (tree->node_count == tree->node_cap) {
+    u32 cap = max(tree->node_cap << 1, 64);
+    bvh_node* nodes = mem_array(bvh_node, cap, tree->arena, .flags = MEM_ALLOC_NO_ZERO);
+    if (tree->node_count) memcpy(nodes, tree->nodes, tree->node_count * sizeof (bvh_node));
+    tree->nodes = nodes;
+    tree->node_cap = cap;
+  }
+
+  return tree->node_count++;
+}
+
+static void bvh__free_node(bvh_tree* tree, u32 id) {
+  tree->nodes[id].parent = tree->free;
+  tree->nodes[id].height = -1;
+  tree->free = id;
+}
+
+static void bvh__replace_child(bvh_tree* tree, u32 parent, u32 old_child, u32 new_child) {
+  if (parent == BVH_NULL) {
+    tree->root = new_child;
+  } else if (tree->nodes[parent].left == old_child) {
+    tree->nodes[parent].left = new_child;
+  } else {
+    tree->nodes[parent].right = new_child;
+  }
+}
+
+// AVL style rotation: if one child of a is more than one level higher than the other, it takes a's place.
+// returns the root of the subtree.
+static u32 bvh__balance(bvh_tree* tree, u32 ia) {
+  bvh_node* nodes = tree->nodes;
+  bvh_node* a = &nodes[ia];
+
+  if (a->height < 2) return ia;
+
+  u32 ib = a->left;
+  u32 ic = a->right;
+  bvh_node* b = &nodes[ib];
+  bvh_node* c = &nodes[ic];
+
+  i32 balance = c->height - b->height;
+
+  if (balance > 1) {
+    u32 i_f = c->left;
+    u32 ig = c->right;
+    bvh_node* f = &nodes[i_f];
+    bvh_node* g = &nodes[ig];
+
+    c->left = ia;
+    c->parent = a->parent;
+    a->parent = ic;
+    bvh__replace_child(tree, c->parent, ia, ic);
+
+    if (f->height > g->height) {
+      c->right = i_f;
+      a->right = ig;
+      g->parent = ia;
+      a->box = bvh__union(b->box, g->box);
+      c->box = bvh__union(a->box, f->box);
+      a->height = 1 + max(b->height, g->height);
+      c->height = 1 + max(a->height, f->height);
+    } else {
+      c->right = ig;
+      a->right = i_f;
+      f->parent = ia;
+      a->box = bvh__union(b->box, f->box);
+      c->box = bvh__union(a->box, g->box);
+      a->height = 1 + max(b->height, f->height);
+      c->height = 1 + max(a->height, g->height);
+    }
+    return ic;
+  }
+
+  if (balance < -1) {
+    u32 id = b->left;
+    u32 ie = b->right;
+    bvh_node* d = &nodes[id];
+    bvh_node* e = &nodes[ie];
+
+    b->left = ia;
+    b->parent = a->parent;
+    a->parent = ib;
+    bvh__replace_child(tree, b->parent, ia, ib);
+
+    if (d->height > e->height) {
+      b->right = id;
+      a->left = ie;
+      e->parent = ia;
+      a->box = bvh__union(c->box, e->box);
+      b->box = bvh__union(a->box, d->box);
+      a->height = 1 + max(c->height, e->height);
+      b->height = 1 + max(a->height, d->height);
+    } else {
+      b->right = ie;
+      a->left = id;
+      d->parent = ia;
+      a->box = bvh__union(c->box, d->box);
+      b->box = bvh__union(a->box, e->box);
+      a->height = 1 + max(c->height, d->height);
+      b->height = 1 + max(a->height, e->height);
+    }
+    return ib;
+  }
+
+  return ia;
+}
+
+// walks up from 'index' rebalancing and refitting every ancestor.
+static void bvh__refit(bvh_tree* tree, u32 index) {
+  while (index != BVH_NULL) {
+    // a rotation can leave the node it pushed down unbalanced when one side was 3 levels higher,
+    // so that node is walked again before going on up through its new parent.
+    if (bvh__balance(tree, index) != index) continue;
+
+    bvh_node* node = &tree->nodes[index];
+    bvh_node* left = &tree->nodes[node->left];
+    bvh_node* right = &tree->nodes[node->right];
+
+    node->height = 1 + max(left->height, right->height);
+    node->box = bvh__union(left->box, right->box);
+
+    index = node->parent;
+  }
+}
+
+static void bvh__insert_leaf(bvh_tree* tree, u32 leaf) {
+  if (tree->root == BVH_NULL) {
+    tree->root = leaf;
+    tree->nodes[leaf].parent = BVH_NULL;
+    return;
+  }
+
+  // branch and bound descent: stop at the node where pairing costs less than pushing the leaf further down.
+  r3 leaf_box = tree->nodes[leaf].box;
+  u32 index = tree->root;
+
+  while (tree->nodes[index].height > 0) {
+    bvh_node* node = &tree->nodes[index];
+    bvh_node* left = &tree->nodes[node->left];
+    bvh_node* right = &tree->nodes[node->right];
+
+    f32 combined_cost = bvh__cost(bvh__union(node->box, leaf_box));
+    f32 cost = 2.0f * combined_cost;
+    f32 inheritance_cost = 2.0f * (combined_cost - bvh__cost(node->box));
+
+    f32 left_cost = bvh__cost(bvh__union(left->box, leaf_box)) + inheritance_cost;
+    f32 right_cost = bvh__cost(bvh__union(right->box, leaf_box)) + inheritance_cost;
+
+    if (left->height > 0) left_cost -= bvh__cost(left->box);
+    if (right->height > 0) right_cost -= bvh__cost(right->box);
+
+    if (cost < left_cost && cost < right_cost) break;
+
+    index = left_cost < right_cost? node->left : node->right;
+  }
+
+  u32 sibling = index;
+  u32 parent = bvh__alloc_node(tree);
+
+  bvh_node* nodes = tree->nodes;
+  u32 old_parent = nodes[sibling].parent;
+
+  nodes[parent].e = 0;
+  nodes[parent].parent = old_parent;
+  nodes[parent].left = sibling;
+  nodes[parent].right = leaf;
+  nodes[parent].height = nodes[sibling].height + 1;
+  nodes[parent].box = bvh__union(nodes[sibling].box, leaf_box);
+
+  bvh__replace_child(tree, old_parent, sibling, parent);
+
+  nodes[sibling].parent = parent;
+  nodes[leaf].parent = parent;
+
+  // from the new node itself, a leaf paired with a tall sibling is the first place that can be unbalanced.
+  bvh__refit(tree, parent);
+}
+
+static void bvh__remove_leaf(bvh_tree* tree, u32 leaf) {
+  if (leaf == tree->root) {
+    tree->root = BVH_NULL;
+    return;
+  }
+
+  bvh_node* nodes = tree->nodes;
+  u32 parent = nodes[leaf].parent;
+  u32 grand_parent = nodes[parent].parent;
+  u32 sibling = nodes[parent].left == leaf? nodes[parent].right : nodes[parent].left;
+
+  bvh__replace_child(tree, grand_parent, parent, sibling);
+  nodes[sibling].parent = grand_parent;
+  bvh__free_node(tree, parent);
+
+  bvh__refit(tree, grand_parent);
+}
+
+ATS_API u32 bvh_insert(bvh_tree* tree, void* e, r3 box) {
+  u32 leaf = bvh__alloc_node(tree);
+  bvh_node* node = &tree->nodes[leaf];
+
+  node->e = e;
+  node->rect = box;
+  node->box = bvh__fatten(tree, box);
+  node->left = BVH_NULL;
+  node->right = BVH_NULL;
+  node->height = 0;
+
+  bvh__insert_leaf(tree, leaf);
+  tree->count++;
+  return leaf;
+}
+
+ATS_API void bvh_remove(bvh_tree* tree, u32 id) {
+  assert(id < tree->node_count && tree->nodes[id].height == 0);
+
+  bvh__remove_leaf(tree, id);
+  bvh__free_node(tree, id);
+  tree->count--;
+}
+
+ATS_API b32 bvh_move(bvh_tree* tree, u32 id, r3 box) {
+  assert(id < tree->node_count && tree->nodes[id].height == 0);
+
+  bvh_node* node = &tree->nodes[id];
+  node->rect = box;
+
+  if (bvh__encloses(node->box, box)) return 0;
+
+  bvh__remove_leaf(tree, id);
+  tree->nodes[id].box = bvh__fatten(tree, box);
+  bvh__insert_leaf(tree, id);
+  return 1;
+}
+
+ATS_API void* bvh_get(bvh_tree* tree, u32 id) {
+  assert(id < tree->node_count && tree->nodes[id].height == 0);
+  return tree->nodes[id].e;
+}
+
+#define bvh__push(stack, count, index) \
+  (assert((count) < BVH_STACK_SIZE), (stack)[(count)++] = (index))
+
+ATS_API u32 bvh_query_box(bvh_tree* tree, r3 box, void* ignore, void** out, u32 out_max) {
+  if (tree->root == BVH_NULL) return 0;
+
+  u32 count = 0;
+  u32 stack_count = 0;
+  u32 stack[BVH_STACK_SIZE];
+
+  bvh__push(stack, stack_count, tree->root);
+
+  while (stack_count) {
+    bvh_node* node = &tree->nodes[stack[--stack_count]];
+    if (!r3_intersect(node->box, box)) continue;
+
+    if (node->height > 0) {
+      bvh__push(stack, stack_count, node->left);
+      bvh__push(stack, stack_count, node->right);
+    } else if (node->e != ignore && r3_intersect(node->rect, box)) {
+      if (count >= out_max) return count;
+      out[count++] = node->e;
+    }
+  }
+  return count;
+}
+
+ATS_API u32 bvh_query_point(bvh_tree* tree, v3 pos, void** out, u32 out_max) {
+  if (tree->root == BVH_NULL) return 0;
+
+  u32 count = 0;
+  u32 stack_count = 0;
+  u32 stack[BVH_STACK_SIZE];
+
+  bvh__push(stack, stack_count, tree->root);
+
+  while (stack_count) {
+    bvh_node* node = &tree->nodes[stack[--stack_count]];
+    if (!r3_contains(node->box, pos)) continue;
+
+    if (node->height > 0) {
+      bvh__push(stack, stack_count, node->left);
+      bvh__push(stack, stack_count, node->right);
+    } else if (r3_contains(node->rect, pos)) {
+      if (count >= out_max) return count;
+      out[count++] = node->e;
+    }
+  }
+  return count;
+}
+
+// slab test, inv_dir components may be inf for axis aligned rays.
+static b32 bvh__ray_box(r3 box, v3 pos, v3 inv_dir, f32 max_t, f32* t_out) {
+  f32 tx0 = (box.min.x - pos.x) * inv_dir.x;
+  f32 tx1 = (box.max.x - pos.x) * inv_dir.x;
+  f32 ty0 = (box.min.y - pos.y) * inv_dir.y;
+  f32 ty1 = (box.max.y - pos.y) * inv_dir.y;
+  f32 tz0 = (box.min.z - pos.z) * inv_dir.z;
+  f32 tz1 = (box.max.z - pos.z) * inv_dir.z;
+
+  f32 t_min = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), 0.0f));
+  f32 t_max = min(min(max(tx0, tx1), max(ty0, ty1)), min(max(tz0, tz1), max_t));
+
+  *t_out = t_min;
+  return t_min <= t_max;
+}
+
+ATS_API u32 bvh_query_ray(bvh_tree* tree, v3 pos, v3 dir, f32 max_t, void** out, u32 out_max) {
+  if (tree->root == BVH_NULL) return 0;
+
+  u32 count = 0;
+  u32 stack_count = 0;
+  u32 stack[BVH_STACK_SIZE];
+
+  v3 inv_dir = { 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+  f32 t = 0;
+
+  bvh__push(stack, stack_count, tree->root);
+
+  while (stack_count) {
+    bvh_node* node = &tree->nodes[stack[--stack_count]];
+    if (!bvh__ray_box(node->box, pos, inv_dir, max_t, &t)) continue;
+
+    if (node->height > 0) {
+      bvh__push(stack, stack_count, node->left);
+      bvh__push(stack, stack_count, node->right);
+    } else if (bvh__ray_box(node->rect, pos, inv_dir, max_t, &t)) {
+      if (count >= out_max) return count;
+      out[count++] = node->e;
+    }
+  }
+  return count;
+}
+
+ATS_API void* bvh_raycast(bvh_tree* tree, v3 pos, v3 dir, f32 max_t, void* ignore, f32* t_out) {
+  if (tree->root == BVH_NULL) return 0;
+
+  void* result = 0;
+  u32 stack_count = 0;
+  u32 stack[BVH_STACK_SIZE];
+
+  v3 inv_dir = { 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+  f32 t = 0;
+
+  bvh__push(stack, stack_count, tree->root);
+
+  while (stack_count) {
+    bvh_node* node = &tree->nodes[stack[--stack_count]];
+    // max_t shrinks with every hit, so whole subtrees behind the closest hit get skipped.
+    if (!bvh__ray_box(node->box, pos, inv_dir, max_t, &t)) continue;
+
+    if (node->height > 0) {
+      bvh__push(stack, stack_count, node->left);
+      bvh__push(stack, stack_count, node->right);
+    } else if (node->e != ignore && bvh__ray_box(node->rect, pos, inv_dir, max_t, &t)) {
+      result = node->e;
+      max_t = t;
+    }
+  }
+
+  if (result && t_out) *t_out = max_t;
+  return result;
+}
+
+ATS_API u32 bvh_query_pairs(bvh_tree* tree, bvh_pair* out, u32 out_max) {
+  u32 count = 0;
+  u32 stack[BVH_STACK_SIZE];
+
+  for (u32 i = 0; i < tree->node_count; ++i) {
+    bvh_node* leaf = &tree->nodes[i];
+    if (leaf->height != 0) continue;
+
+    u32 stack_count = 0;
+    bvh__push(stack, stack_count, tree->root);
+
+    while (stack_count) {
+      u32 index = stack[--stack_count];
+      bvh_node* node = &tree->nodes[index];
+      if (!r3_intersect(node->box, leaf->rect)) continue;
+
+      if (node->height > 0) {
+        bvh__push(stack, stack_count, node->left);
+        bvh__push(stack, stack_count, node->right);
+      } else if (index > i && r3_intersect(node->rect, leaf->rect)) {
+        // every pair is found from both leaves, only the lower id reports it.
+        if (count >= out_max) return count;
+        out[count].a = leaf->e;
+        out[count].b = node->e;
+        count++;
+      }
+    }
+  }
+  return count;
+}
+
+#undef bvh__push
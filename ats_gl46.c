@@ -713,25 +713,20 @@ static int gl__timer_cmp(const void* va, const void* vb) {
 }
 
 static void gl_timer_print_table(f32 px, f32 py, f32 sx, f32 sy, u32 color) {
-  static timer_node array[countof(timer_table)];
+  mem_scratch_scope(scratch, 0) {
+    u32 count = timer_node_count;
+    i32 y = 0;
 
-  u32 count = 0;
-  i32 y = 0;
-
-  for (i32 i = 0; i < countof(timer_table); i++) {
-    timer_node node = timer_table[i];
-    if (!node.name) {
-      continue;
-    }
-    array[count++] = node;
-  }
+    timer_node* array = mem_array(timer_node, count, scratch, .flags = MEM_ALLOC_NO_ZERO);
+    memcpy(array, timer_table, count * sizeof (timer_node));
 
-  qsort(array, count, sizeof (timer_node), gl__timer_cmp);
+    qsort(array, count, sizeof (timer_node), gl__timer_cmp);
 
-  for (i32 i = 0; i < count; i++) {
-    timer_node e = array[i];
-    gl_string_format(px, py + y * (sy + 1), 0, sx, sy, color, "%s : %.2f : %.2f", e.name, 1000.0 * e.max, 1000.0 * e.current);
-    y++;
+    for (i32 i = 0; i < count; i++) {
+      timer_node e = array[i];
+      gl_string_format(px, py + y * (sy + 1), 0, sx, sy, color, "%s : %.2f : %.2f", e.name, 1000.0 * e.max, 1000.0 * e.current);
+      y++;
+    }
   }
 
   timer_reset_all();
@@ -518,6 +518,7 @@ static void platform_update(void) {
   platform_swap_buffers();
   platform_poll_events();
   platform_end_frame();
+  mem_frame_swap();
 }
 
 ATS_API void platform_init(const char* title, int width, int height, int samples) {
@@ -1,9 +1,129 @@
 #include "ats.h"
 
-static mem_arena* mem_stack;
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static ATS_THREAD_LOCAL mem_arena* mem_stack;
+static ATS_THREAD_LOCAL mem_arena mem_scratch_array[2];
+
+// ====================================== ATOMICS ==================================== //
+
+#ifdef _MSC_VER
+#define mem__atomic_exchange(ptr, val)  _InterlockedExchange((volatile long*)(ptr), (val))
+#define mem__atomic_release(ptr)        _InterlockedExchange((volatile long*)(ptr), 0)
+#define mem__atomic_load32(ptr)         _InterlockedOr((volatile long*)(ptr), 0)
+#define mem__atomic_add64(ptr, val)     (u64)_InterlockedExchangeAdd64((volatile __int64*)(ptr), (__int64)(val))
+#define mem__atomic_load64(ptr)         (u64)_InterlockedOr64((volatile __int64*)(ptr), 0)
+#define mem__atomic_store64(ptr, val)   _InterlockedExchange64((volatile __int64*)(ptr), (__int64)(val))
+#define mem__atomic_pause()             _mm_pause()
+#else
+#define mem__atomic_exchange(ptr, val)  __atomic_exchange_n((ptr), (val), __ATOMIC_ACQUIRE)
+#define mem__atomic_release(ptr)        __atomic_store_n((ptr), 0, __ATOMIC_RELEASE)
+#define mem__atomic_load32(ptr)         __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define mem__atomic_add64(ptr, val)     __atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+#define mem__atomic_load64(ptr)         __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define mem__atomic_store64(ptr, val)   __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#if defined(__x86_64__) || defined(__i386__)
+#define mem__atomic_pause()             __builtin_ia32_pause()
+#else
+#define mem__atomic_pause()             ((void)0)
+#endif
+#endif
+
+static void mem__lock(volatile i32* lock) {
+  while (mem__atomic_exchange(lock, 1)) {
+    while (mem__atomic_load32(lock)) mem__atomic_pause();
+  }
+}
+
+// release store, or a full barrier on msvc, so writes in the lock are visible before it opens.
+static void mem__unlock(volatile i32* lock) {
+  mem__atomic_release(lock);
+}
+
+// ====================================== OS PAGES =================================== //
+
+static void* mem__os_reserve(usize size) {
+#ifdef _WIN32
+  return VirtualAlloc(0, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+  void* ptr = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return ptr == MAP_FAILED? 0 : ptr;
+#endif
+}
+
+static b32 mem__os_commit(void* ptr, usize size) {
+#ifdef _WIN32
+  return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != 0;
+#else
+  return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+static void mem__os_decommit(void* ptr, usize size) {
+#ifdef _WIN32
+  VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+  madvise(ptr, size, MADV_DONTNEED);
+  mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+static void mem__os_release(void* ptr, usize size) {
+#ifdef _WIN32
+  VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+  munmap(ptr, size);
+#endif
+}
+
+// makes sure [0, pos) is backed by memory.
+static void mem__ensure(mem_arena* arena, usize pos) {
+  assert(pos <= arena->cap && "mem_arena out of memory");
+  if (!(arena->flags & MEM_FLAG_RESERVE) || pos <= arena->commit) return;
+
+  usize commit = min(align_up(pos, (usize)MEM_COMMIT_SIZE), arena->cap);
+  b32 ok = mem__os_commit(arena->buf + arena->commit, commit - arena->commit);
+  assert(ok && "mem_arena commit failed");
+  (void)ok;
+
+  arena->commit = commit;
+}
+
+// gives the pages past pos + MEM_DECOMMIT_SLACK back to the os.
+static void mem__shrink(mem_arena* arena, usize pos) {
+  if (!(arena->flags & MEM_FLAG_RESERVE)) return;
+
+  usize keep = min(align_up(pos + MEM_DECOMMIT_SLACK, (usize)MEM_COMMIT_SIZE), arena->cap);
+  if (keep >= arena->commit) return;
+
+  mem__os_decommit(arena->buf + keep, arena->commit - keep);
+  arena->commit = keep;
+  arena->dirty = min(arena->dirty, keep);
+}
+
+// only clears the part of the range that has been handed out before.
+static void* mem__zero(mem_arena* arena, u8* ptr, usize size) {
+  if (!(arena->flags & MEM_FLAG_LAZY_ZERO)) return memset(ptr, 0, size);
+
+  usize offset = ptr - arena->buf;
+  if (offset < arena->dirty) {
+    memset(ptr, 0, min(size, arena->dirty - offset));
+  }
+  return ptr;
+}
+
+// ====================================== ARENA ====================================== //
 
 ATS_API void mem_init(void* data, usize size) {
-  static mem_arena arena;
+  static ATS_THREAD_LOCAL mem_arena arena;
   arena = mem_create(data, size);
   mem_push(&arena);
 }
@@ -15,6 +135,22 @@ ATS_API mem_arena mem_create(void* data, usize size) {
   return arena;
 }
 
+ATS_API mem_arena mem_reserve(usize size) {
+  mem_arena arena = {0};
+  arena.cap = align_up(size, (usize)MEM_COMMIT_SIZE);
+  arena.buf = (u8*)mem__os_reserve(arena.cap);
+  arena.flags = MEM_FLAG_RESERVE | MEM_FLAG_LAZY_ZERO;
+  assert(arena.buf && "mem_reserve failed");
+  return arena;
+}
+
+ATS_API void mem_release(mem_arena* arena) {
+  if (arena->flags & MEM_FLAG_RESERVE) {
+    mem__os_release(arena->buf, arena->cap);
+  }
+  memset(arena, 0, sizeof *arena);
+}
+
 #define MEM_GET(arg) ((arg).arena? (arg).arena : (mem_stack))
 
 typedef struct {
@@ -22,21 +158,136 @@ typedef struct {
   usize count;
 } mem_header;
 
+// ================================== CONCURRENT ARENA =============================== //
+
+// per thread chunks carved out of concurrent arenas, tagged with the arena generation
+// so chunks taken before a mem_restore are never reused after it.
+typedef struct {
+  mem_arena* arena;
+  u32 generation;
+  usize pos;
+  usize end;
+} mem__chunk;
+
+static volatile u64 mem__generation;
+static ATS_THREAD_LOCAL u32 mem__chunk_next;
+static ATS_THREAD_LOCAL mem__chunk mem__chunk_array[4];
+
+static usize mem__offset(mem_arena* arena, usize pos, usize header_size, usize align) {
+  uintptr_t base = (uintptr_t)arena->buf;
+  return align_up(base + pos + header_size, align) - base;
+}
+
+static void mem__ensure_concurrent(mem_arena* arena, usize pos) {
+  assert(pos <= arena->cap && "mem_arena out of memory");
+  if (!(arena->flags & MEM_FLAG_RESERVE) || pos <= mem__atomic_load64(&arena->commit)) return;
+
+  mem__lock(&arena->lock);
+  if (pos > arena->commit) {
+    usize commit = min(align_up(pos, (usize)MEM_COMMIT_SIZE), arena->cap);
+    b32 ok = mem__os_commit(arena->buf + arena->commit, commit - arena->commit);
+    assert(ok && "mem_arena commit failed");
+    (void)ok;
+    mem__atomic_store64(&arena->commit, commit);
+  }
+  mem__unlock(&arena->lock);
+}
+
+static usize mem__bump_concurrent(mem_arena* arena, usize header_size, usize align, usize size) {
+  usize need = header_size + size + align - 1;
+
+  if (need > MEM_CONCURRENT_CHUNK / 4) {
+    usize pos = mem__atomic_add64(&arena->pos, need);
+    usize offset = mem__offset(arena, pos, header_size, align);
+    mem__ensure_concurrent(arena, offset + size);
+    return offset;
+  }
+
+  mem__chunk* chunk = 0;
+  for_array(i, mem__chunk_array) {
+    mem__chunk* it = &mem__chunk_array[i];
+    if (it->arena == arena && it->generation == arena->generation) {
+      chunk = it;
+      break;
+    }
+  }
+
+  if (!chunk || mem__offset(arena, chunk->pos, header_size, align) + size > chunk->end) {
+    if (!chunk) chunk = &mem__chunk_array[mem__chunk_next++ % countof(mem__chunk_array)];
+
+    chunk->arena = arena;
+    chunk->generation = arena->generation;
+    chunk->pos = mem__atomic_add64(&arena->pos, MEM_CONCURRENT_CHUNK);
+    chunk->end = chunk->pos + MEM_CONCURRENT_CHUNK;
+
+    mem__ensure_concurrent(arena, chunk->end);
+  }
+
+  usize offset = mem__offset(arena, chunk->pos, header_size, align);
+  chunk->pos = offset + size;
+  return offset;
+}
+
+ATS_API void mem_set_concurrent(mem_arena* arena) {
+  arena->flags |= MEM_FLAG_CONCURRENT;
+  arena->generation = (u32)mem__atomic_add64(&mem__generation, 1) + 1;
+}
+
+// ====================================== ALLOC ====================================== //
+
 ATS_API void* mem__alloc(mem__alloc_desc desc) {
   mem_arena* arena = MEM_GET(desc);
-  mem_header* header = (mem_header*)(arena->buf + arena->pos);
+  usize align = def(desc.align, MEM_DEFAULT_ALIGN);
+  usize header_size = (desc.flags & MEM_ALLOC_NO_HEADER)? 0 : sizeof (mem_header);
+
+  assert(is_power_of_two(align));
 
-  arena->pos += sizeof (mem_header) + desc.size;
-  header->size = desc.size;
-  header->count = desc.count? desc.count : desc.size; 
+  if (arena->flags & MEM_FLAG_CONCURRENT) {
+    // 'dirty' only moves in mem_restore for these, so reading it here is fine.
+    u8* ptr = arena->buf + mem__bump_concurrent(arena, header_size, align, desc.size);
 
+    if (header_size) {
+      mem_header* header = (mem_header*)ptr - 1;
+      header->size = desc.size;
+      header->count = desc.count? desc.count : desc.size; 
+    }
+
+    if (!(desc.flags & MEM_ALLOC_NO_ZERO)) {
+      mem__zero(arena, ptr, desc.size);
+    }
+    return ptr;
+  }
+
+  usize offset = mem__offset(arena, arena->pos, header_size, align);
+
+  mem__ensure(arena, offset + desc.size);
+
+  u8* ptr = arena->buf + offset;
+  arena->pos = offset + desc.size;
   arena->max = max(arena->pos, arena->max);
 
-  return memset(header + 1, 0, desc.size);
+  if (header_size) {
+    mem_header* header = (mem_header*)ptr - 1;
+    header->size = desc.size;
+    header->count = desc.count? desc.count : desc.size; 
+  }
+
+  if (!(desc.flags & MEM_ALLOC_NO_ZERO)) {
+    mem__zero(arena, ptr, desc.size);
+  }
+
+  arena->dirty = max(arena->pos, arena->dirty);
+  return ptr;
 }
 
 ATS_API void mem__save(mem__arena_desc desc) {
   mem_arena* arena = MEM_GET(desc);
+
+  if (arena->flags & MEM_FLAG_CONCURRENT) {
+    // retire chunks handed out before the save point.
+    arena->generation = (u32)mem__atomic_add64(&mem__generation, 1) + 1;
+  }
+
   usize pos = arena->pos;
   mem_index* node = mem_type(mem_index, arena);
 
@@ -46,22 +297,60 @@ ATS_API void mem__save(mem__arena_desc desc) {
   arena->stack = node;
 }
 
+static void mem__rewind_to(mem_arena* arena, usize pos) {
+  if (arena->flags & MEM_FLAG_CONCURRENT) {
+    arena->max = max(arena->pos, arena->max);
+    arena->dirty = max(arena->pos, arena->dirty);
+    arena->generation = (u32)mem__atomic_add64(&mem__generation, 1) + 1;
+  }
+
+  // pages stay committed, the next allocations would only fault them back in.
+  arena->pos = pos;
+}
+
 ATS_API void mem__restore(mem__arena_desc desc) {
   mem_arena* arena = MEM_GET(desc);
+  mem_index* node = arena->stack;
+
+  arena->stack = node->next;
+  mem__rewind_to(arena, node->pos);
+}
+
+ATS_API mem_mark mem__mark(mem__arena_desc desc) {
+  mem_mark mark = {0};
+  mark.arena = MEM_GET(desc);
+  mark.pos = mark.arena->pos;
+
+  if (mark.arena->flags & MEM_FLAG_CONCURRENT) {
+    mark.arena->generation = (u32)mem__atomic_add64(&mem__generation, 1) + 1;
+  }
+  return mark;
+}
 
-  arena->pos = arena->stack->pos;
-  arena->stack = arena->stack->next;
+ATS_API void mem_rewind(mem_mark mark) {
+  mem__rewind_to(mark.arena, mark.pos);
+}
+
+ATS_API void mem_trim(mem_arena* arena) {
+  mem__shrink(arena, arena->pos);
 }
 
 ATS_API void* mem__begin(mem__arena_desc desc) {
   mem_arena* arena = MEM_GET(desc);
+  assert(!(arena->flags & MEM_FLAG_CONCURRENT));
+  mem__ensure(arena, min(arena->pos + MEM_TEMP_SIZE, arena->cap));
+  // the caller may write anywhere past pos, so treat it all as dirty.
+  arena->dirty = (arena->flags & MEM_FLAG_RESERVE)? max(arena->commit, arena->dirty) : arena->cap;
   void* ptr = arena->buf + arena->pos;
   return ptr;
 }
 
 ATS_API void mem__end(usize size, mem__arena_desc desc) {
   mem_arena* arena = MEM_GET(desc);
+  mem__ensure(arena, arena->pos + size);
   arena->pos += size;
+  arena->max = max(arena->pos, arena->max);
+  arena->dirty = max(arena->pos, arena->dirty);
 }
 
 ATS_API void mem_push(mem_arena* arena) {
@@ -74,6 +363,353 @@ ATS_API void mem_pop(void) {
 }
 
 ATS_API usize mem_max(void) {
-  return mem_stack? mem_stack->max : 0;
+  return mem_stack? max(mem_stack->pos, mem_stack->max) : 0;
+}
+
+// ====================================== FRAME ====================================== //
+
+static u32 mem__frame_index;
+static mem_arena mem__frame_array[2];
+static u32 mem__frame_low[2];   // swaps in a row that used less than half of the committed pages
+static usize mem__frame_peak[2]; // most used by one of those swaps
+
+ATS_API mem_arena* mem_frame(void) {
+  mem_arena* arena = &mem__frame_array[mem__frame_index];
+  if (!arena->buf) *arena = mem_reserve(MEM_FRAME_SIZE);
+  return arena;
+}
+
+ATS_API mem_arena* mem_frame_last(void) {
+  mem_arena* arena = &mem__frame_array[mem__frame_index ^ 1];
+  if (!arena->buf) *arena = mem_reserve(MEM_FRAME_SIZE);
+  return arena;
+}
+
+ATS_API void mem_frame_swap(void) {
+  mem__frame_index ^= 1;
+
+  u32 index = mem__frame_index;
+  mem_arena* arena = &mem__frame_array[index];
+  if (arena->buf) {
+    // 'max' is reset every swap, so it is the peak of the frame that is being thrown away.
+    usize used = max(arena->pos, arena->max);
+    arena->max = 0;
+
+    // only trim after a spike is long gone, a steady frame never decommits.
+    if (used + MEM_DECOMMIT_SLACK < arena->commit / 2) {
+      mem__frame_peak[index] = max(mem__frame_peak[index], used);
+      if (++mem__frame_low[index] >= MEM_FRAME_TRIM_SWAPS) {
+        mem__shrink(arena, mem__frame_peak[index]);
+        mem__frame_low[index] = 0;
+        mem__frame_peak[index] = 0;
+      }
+    } else {
+      mem__frame_low[index] = 0;
+      mem__frame_peak[index] = 0;
+    }
+
+    arena->stack = 0;
+    mem__rewind_to(arena, 0);
+  }
+}
+
+// ===================================== SCRATCH ===================================== //
+
+ATS_API mem_arena* mem_scratch(mem_arena* conflict) {
+  mem_arena* arena = &mem_scratch_array[0];
+  if (arena == conflict) arena = &mem_scratch_array[1];
+  if (!arena->buf) *arena = mem_reserve(MEM_SCRATCH_SIZE);
+  return arena;
+}
+
+ATS_API void mem_scratch_release(void) {
+  for_array(i, mem_scratch_array) {
+    if (mem_scratch_array[i].buf) mem_release(&mem_scratch_array[i]);
+  }
+}
+
+// ====================================== POOL ======================================= //
+
+typedef struct mem__pool_block mem__pool_block;
+struct mem__pool_block {
+  mem__pool_block* next;
+};
+
+ATS_API mem_pool mem__pool_create(mem__pool_desc desc) {
+  mem_pool pool = {0};
+  pool.align = def(desc.align, sizeof (void*));
+  pool.size = align_up(max(desc.size, sizeof (mem__pool_block)), pool.align);
+  pool.arena = MEM_GET(desc);
+  return pool;
+}
+
+static void mem__pool_grow(mem_pool* pool) {
+  u8* chunk = mem_alloc(pool->size * MEM_POOL_CHUNK, 0, pool->arena, pool->align, MEM_ALLOC_NO_HEADER | MEM_ALLOC_NO_ZERO);
+  for (usize i = MEM_POOL_CHUNK; i > 0; --i) {
+    mem__pool_block* block = (mem__pool_block*)(chunk + (i - 1) * pool->size);
+    block->next = pool->free;
+    pool->free = block;
+  }
+}
+
+ATS_API void* mem_pool_alloc(mem_pool* pool) {
+  if (!pool->free) mem__pool_grow(pool);
+
+  mem__pool_block* block = pool->free;
+  pool->free = block->next;
+  pool->count++;
+
+  return memset(block, 0, pool->size);
+}
+
+ATS_API void mem_pool_free(mem_pool* pool, void* ptr) {
+  mem__pool_block* block = ptr;
+  block->next = pool->free;
+  pool->free = block;
+  pool->count--;
+}
+
+ATS_API mem_pool_cache mem_pool_cache_create(mem_pool* pool) {
+  mem_pool_cache cache = {0};
+  cache.pool = pool;
+  return cache;
+}
+
+ATS_API void* mem_pool_cache_alloc(mem_pool_cache* cache) {
+  if (!cache->free) {
+    mem_pool* pool = cache->pool;
+
+    mem__lock(&pool->lock);
+    while (cache->count < MEM_POOL_CACHE_SIZE / 2) {
+      if (!pool->free) mem__pool_grow(pool);
+
+      mem__pool_block* block = pool->free;
+      pool->free = block->next;
+      block->next = cache->free;
+      cache->free = block;
+      cache->count++;
+    }
+    pool->count += cache->count;
+    mem__unlock(&pool->lock);
+  }
+
+  mem__pool_block* block = cache->free;
+  cache->free = block->next;
+  cache->count--;
+
+  return memset(block, 0, cache->pool->size);
+}
+
+static void mem__pool_cache_return(mem_pool_cache* cache, u32 keep) {
+  mem_pool* pool = cache->pool;
+
+  mem__lock(&pool->lock);
+  while (cache->count > keep) {
+    mem__pool_block* block = cache->free;
+    cache->free = block->next;
+    block->next = pool->free;
+    pool->free = block;
+    cache->count--;
+    pool->count--;
+  }
+  mem__unlock(&pool->lock);
+}
+
+ATS_API void mem_pool_cache_free(mem_pool_cache* cache, void* ptr) {
+  mem__pool_block* block = ptr;
+  block->next = cache->free;
+  cache->free = block;
+  cache->count++;
+
+  if (cache->count >= MEM_POOL_CACHE_SIZE) {
+    mem__pool_cache_return(cache, MEM_POOL_CACHE_SIZE / 2);
+  }
+}
+
+ATS_API void mem_pool_cache_flush(mem_pool_cache* cache) {
+  mem__pool_cache_return(cache, 0);
+}
+
+// ====================================== TRACE ====================================== //
+
+#ifdef ATS_MEM_TRACE
+
+enum {
+  MEM__TRACE_ALLOC,
+  MEM__TRACE_SCOPE,
+};
+
+typedef struct {
+  const char* file;
+  i32 line;
+  u32 kind;
+
+  usize bytes; // total for alloc sites, worst peak for scope sites
+  usize count;
+} mem__trace_site;
+
+typedef struct {
+  mem_arena* arena;
+  usize pos;
+  usize peak;
+  b32 is_push;
+  mem__trace_site* site;
+} mem__trace_frame;
+
+static volatile i32 mem__trace_lock;
+static mem__trace_site mem__trace_table[MEM_TRACE_SITES];
+
+static ATS_THREAD_LOCAL u32 mem__trace_depth;
+static ATS_THREAD_LOCAL mem__trace_frame mem__trace_stack[256];
+
+// NOTE: caller holds mem__trace_lock.
+static mem__trace_site* mem__trace_get_site(const char* file, i32 line, u32 kind) {
+  u32 hash = hash3u((u32)(uintptr_t)file, line, kind);
+  for (u32 i = 0; i < MEM_TRACE_SITES; ++i) {
+    mem__trace_site* site = &mem__trace_table[(hash + i) & (MEM_TRACE_SITES - 1)];
+    if (!site->file) {
+      site->file = file;
+      site->line = line;
+      site->kind = kind;
+      return site;
+    }
+    if (site->line == line && site->kind == kind && site->file == file) {
+      return site;
+    }
+  }
+  assert(0 && "MEM_TRACE_SITES is too small");
+  return 0;
+}
+
+static mem__trace_frame* mem__trace_find(mem_arena* arena, u32 from) {
+  for (u32 i = from; i > 0; --i) {
+    if (mem__trace_stack[i - 1].arena == arena) return &mem__trace_stack[i - 1];
+  }
+  return 0;
+}
+
+static void mem__trace_begin(mem_arena* arena, const char* file, i32 line, b32 is_push) {
+  assert(mem__trace_depth < countof(mem__trace_stack));
+
+  mem__trace_frame* frame = &mem__trace_stack[mem__trace_depth++];
+  frame->arena = arena;
+  frame->pos = arena->pos;
+  frame->peak = arena->pos;
+  frame->is_push = is_push;
+
+  mem__lock(&mem__trace_lock);
+  frame->site = mem__trace_get_site(file, line, MEM__TRACE_SCOPE);
+  mem__unlock(&mem__trace_lock);
+}
+
+static void mem__trace_end(mem_arena* arena, b32 is_push) {
+  // frames are popped in stack order, mem_restore pops the latest save of its arena.
+  u32 index = mem__trace_depth;
+  while (index > 0) {
+    mem__trace_frame* it = &mem__trace_stack[index - 1];
+    if (it->is_push == is_push && (is_push || it->arena == arena)) break;
+    index--;
+  }
+  if (!index) return;
+
+  mem__trace_frame frame = mem__trace_stack[index - 1];
+  memmove(&mem__trace_stack[index - 1], &mem__trace_stack[index], (mem__trace_depth - index) * sizeof frame);
+  mem__trace_depth--;
+
+  mem__trace_frame* outer = mem__trace_find(frame.arena, index - 1);
+  if (outer) outer->peak = max(outer->peak, frame.peak);
+
+  mem__lock(&mem__trace_lock);
+  frame.site->bytes = max(frame.site->bytes, frame.peak - frame.pos);
+  frame.site->count++;
+  mem__unlock(&mem__trace_lock);
+}
+
+ATS_API void* mem__alloc_trace(mem__alloc_desc desc, const char* file, i32 line) {
+  mem_arena* arena = MEM_GET(desc);
+  usize pos = arena->pos;
+  void* ptr = mem__alloc(desc);
+
+  mem__trace_frame* frame = mem__trace_find(arena, mem__trace_depth);
+  if (frame) frame->peak = max(frame->peak, arena->pos);
+
+  mem__lock(&mem__trace_lock);
+  mem__trace_site* site = mem__trace_get_site(file, line, MEM__TRACE_ALLOC);
+  site->bytes += arena->pos - pos;
+  site->count++;
+  mem__unlock(&mem__trace_lock);
+
+  return ptr;
+}
+
+ATS_API void mem__save_trace(mem__arena_desc desc, const char* file, i32 line) {
+  mem_arena* arena = MEM_GET(desc);
+  mem__trace_begin(arena, file, line, 0);
+  mem__save(desc);
+}
+
+ATS_API void mem__restore_trace(mem__arena_desc desc) {
+  mem_arena* arena = MEM_GET(desc);
+  mem__trace_end(arena, 0);
+  mem__restore(desc);
+}
+
+ATS_API mem_mark mem__mark_trace(mem__arena_desc desc, const char* file, i32 line) {
+  mem_arena* arena = MEM_GET(desc);
+  mem__trace_begin(arena, file, line, 0);
+  return mem__mark(desc);
+}
+
+ATS_API void mem__rewind_trace(mem_mark mark) {
+  mem__trace_end(mark.arena, 0);
+  mem_rewind(mark);
+}
+
+ATS_API void mem__push_trace(mem_arena* arena, const char* file, i32 line) {
+  mem__trace_begin(arena, file, line, 1);
+  mem_push(arena);
+}
+
+ATS_API void mem__pop_trace(void) {
+  mem__trace_end(mem_stack, 1);
+  mem_pop();
+}
+
+static int mem__trace_cmp(const void* va, const void* vb) {
+  const mem__trace_site* a = va;
+  const mem__trace_site* b = vb;
+  if (a->kind != b->kind) return a->kind < b->kind? -1 : 1;
+  if (a->bytes != b->bytes) return a->bytes > b->bytes? -1 : 1;
+  return 0;
+}
+
+ATS_API void mem_trace_report(FILE* out) {
+  static mem__trace_site array[MEM_TRACE_SITES];
+  u32 count = 0;
+
+  mem__lock(&mem__trace_lock);
+  for_array(i, mem__trace_table) {
+    if (mem__trace_table[i].file) array[count++] = mem__trace_table[i];
+  }
+  mem__unlock(&mem__trace_lock);
+
+  sort(array, count, mem__trace_cmp);
+
+  u32 kind = ~0u;
+  for (u32 i = 0; i < count; ++i) {
+    mem__trace_site* site = &array[i];
+    if (site->kind != kind) {
+      kind = site->kind;
+      fprintf(out, kind == MEM__TRACE_ALLOC? "%14s %10s  alloc site\n" : "%14s %10s  scope site\n", kind == MEM__TRACE_ALLOC? "bytes" : "peak", "count");
+    }
+    fprintf(out, "%14llu %10llu  %s:%d\n", (unsigned long long)site->bytes, (unsigned long long)site->count, site->file, site->line);
+  }
+}
+
+ATS_API void mem_trace_reset(void) {
+  mem__lock(&mem__trace_lock);
+  memset(mem__trace_table, 0, sizeof (mem__trace_table));
+  mem__unlock(&mem__trace_lock);
 }
 
+#endif // ATS_MEM_TRACE
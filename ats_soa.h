@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ats.h"
+
+// ============================================ SOA ================================================= //
+// generates a structure-of-arrays container, every field gets its own SOA_ALIGN aligned column
+// and all columns are kept in lockstep by add / remove. the functions are static inline, so unused
+// ones don't warn.
+//
+// Example:
+// #define ENTITY_FIELDS(X) X(v2, pos) X(v2, vel) X(u32, flags)
+//
+// soa_declare(entity_soa, ENTITY_FIELDS)
+//
+// entity_soa es = {0};                   // heap backed, or set es.arena before the first add
+// usize i = entity_soa_add(&es);         // new row, zeroed
+// es.pos[i] = v2(1, 2);
+//
+// soa_for(&es, i) {
+//   es.pos[i] = v2_add(es.pos[i], es.vel[i]);
+// }
+//
+// entity_soa_remove(&es, i);             // moves the last row into i
+// entity_soa_free(&es);
+
+#ifndef SOA_ALIGN
+#define SOA_ALIGN (64)
+#endif
+
+#define soa_for(soa, index) for (usize index = 0; index < (soa)->len; ++index)
+
+#define SOA__FIELD(type, name)    type* name;
+#define SOA__SIZE(type, name)     size += align_up(sizeof (type) * cap, (usize)SOA_ALIGN);
+#define SOA__MOVE(type, name) \
+  if (soa->len) memcpy(ptr, soa->name, sizeof (type) * soa->len); \
+  soa->name = (type*)ptr; \
+  ptr += align_up(sizeof (type) * cap, (usize)SOA_ALIGN);
+#define SOA__ZERO(type, name)     memset(&soa->name[index], 0, sizeof (type));
+#define SOA__SWAP(type, name)     soa->name[index] = soa->name[last];
+
+#define soa_declare(soa_t, FIELDS) \
+  typedef struct { \
+    usize len; \
+    usize cap; \
+    mem_arena* arena; /* null for heap backed containers */ \
+    void* block; \
+    FIELDS(SOA__FIELD) \
+  } soa_t; \
+  \
+  static inline void soa_t##_reserve(soa_t* soa, usize cap) { \
+    if (cap <= soa->cap) return; \
+    usize size = 0; \
+    FIELDS(SOA__SIZE) \
+    void* block = soa->arena? \
+      mem_alloc(size, 0, soa->arena, SOA_ALIGN, MEM_ALLOC_NO_HEADER | MEM_ALLOC_NO_ZERO) : \
+      malloc(size + SOA_ALIGN); \
+    u8* ptr = soa->arena? block : align_up_ptr(block, SOA_ALIGN); \
+    FIELDS(SOA__MOVE) \
+    if (!soa->arena) free(soa->block); \
+    soa->block = block; \
+    soa->cap = cap; \
+  } \
+  \
+  static inline usize soa_t##_add(soa_t* soa) { \
+    if (soa->len == soa->cap) soa_t##_reserve(soa, max(soa->cap << 1, (usize)64)); \
+    usize index = soa->len++; \
+    FIELDS(SOA__ZERO) \
+    return index; \
+  } \
+  \
+  static inline void soa_t##_remove(soa_t* soa, usize index) { \
+    assert(index < soa->len); \
+    usize last = --soa->len; \
+    FIELDS(SOA__SWAP) \
+  } \
+  \
+  static inline void soa_t##_clear(soa_t* soa) { \
+    soa->len = 0; \
+  } \
+  \
+  static inline void soa_t##_free(soa_t* soa) { \
+    if (!soa->arena) free(soa->block); \
+    memset(soa, 0, sizeof *soa); \
+  }
@@ -12,7 +12,6 @@
 
 #define TEXTURE_TABLE_LOG2  (12)
 #define TEXTURE_TABLE_SIZE  (1 << TEXTURE_TABLE_LOG2)
-#define TEXTURE_TABLE_MOD   (TEXTURE_TABLE_SIZE - 1)
 
 struct tex_frame {
   struct tex_frame* next;
@@ -55,7 +54,8 @@ static struct {
   u16 height;
   u32* pixels;
 
-  struct tex_entity* entity[TEXTURE_TABLE_SIZE];
+  hash_map entity_map; // name -> struct tex_entity*
+  struct tex_entity* entity;
 
   struct {
     u32 count;
@@ -142,17 +142,15 @@ static tex_rect tex__get_fit(u16 width, u16 height) {
 }
 
 static struct tex_entity* tex__get_entity(const char* name) {
-  u32 hash = hash_str(name);
-  u32 index = hash & TEXTURE_TABLE_MOD;
-  for (struct tex_entity* e = tex.entity[index]; e; e = e->next) {
-    if (strcmp(e->name, name) == 0) {
-      return e;
-    }
+  u64* value = hash_map_put_str(&tex.entity_map, name);
+  if (*value) {
+    return (struct tex_entity*)(uintptr_t)*value;
   }
   struct tex_entity* e = mem_type(struct tex_entity);
-  e->next = tex.entity[index];
+  e->next = tex.entity;
   tex__str_copy(e->name, countof(e->name), name);
-  tex.entity[index] = e;
+  tex.entity = e;
+  *value = (uintptr_t)e;
   return e;
 }
 
@@ -200,9 +198,6 @@ static struct tex_frame* tex__get_frame(struct tex_animation* a, const char* nam
 }
 
 static void tex__add_frame(struct tex_image* image, tex_rect rect, tex_rect fitted) {
-  u32 hash = hash_str(image->frame);
-  u16 index = hash & TEXTURE_TABLE_MOD;
-
   struct tex_entity* entity = tex__get_entity(image->entity);
   struct tex_animation* animation = tex__get_animation(entity, image->animation);
   struct tex_frame* frame = tex__get_frame(animation, image->frame);
@@ -271,6 +266,7 @@ ATS_API void tex_load_dir(const char* texture_path) {
 }
 
 ATS_API void tex_begin(u16 width, u16 height) {
+  hash_map_free(&tex.entity_map);
   memset(&tex, 0, sizeof (tex));
 
   tex.width  = width;
@@ -392,10 +388,8 @@ ATS_API void tex_save(const char* name) {
   {
     emit("enum {\n");
     emit("  TE_none,\n");
-    for (u32 i = 0; i < TEXTURE_TABLE_SIZE; ++i) {
-      for (struct tex_entity* node = tex.entity[i]; node; node = node->next)
-        emit("  TE_%s,\n", node->name);
-    }
+    for (struct tex_entity* node = tex.entity; node; node = node->next)
+      emit("  TE_%s,\n", node->name);
     emit("  TE_count,\n");
     emit("};\n\n");
   }
@@ -406,21 +400,19 @@ ATS_API void tex_save(const char* name) {
     char* used_array[TEXTURE_TABLE_SIZE];
 
     emit("enum {\n");
-    for (u32 i = 0; i < TEXTURE_TABLE_SIZE; ++i) {
-      for (struct tex_entity* entity = tex.entity[i]; entity; entity = entity->next) {
-        for (struct tex_animation* animation = entity->animation; animation; animation = animation->next) {
-          u32 emit_enum = 1;
-          for (u32 j = 0; j < used_count; ++j) {
-            if (strcmp(used_array[j], animation->name) == 0) {
-              emit_enum = 0;
-              break;
-            }
-          }
-          if (emit_enum) {
-            emit("  TA_%s,\n", animation->name);
-            used_array[used_count++] = animation->name;
+    for (struct tex_entity* entity = tex.entity; entity; entity = entity->next) {
+      for (struct tex_animation* animation = entity->animation; animation; animation = animation->next) {
+        u32 emit_enum = 1;
+        for (u32 j = 0; j < used_count; ++j) {
+          if (strcmp(used_array[j], animation->name) == 0) {
+            emit_enum = 0;
+            break;
           }
         }
+        if (emit_enum) {
+          emit("  TA_%s,\n", animation->name);
+          used_array[used_count++] = animation->name;
+        }
       }
     }
     emit("  TA_count,\n");
@@ -431,12 +423,10 @@ ATS_API void tex_save(const char* name) {
   {
     emit("enum {\n");
     emit("  TF_none,\n");
-    for (u32 i = 0; i < TEXTURE_TABLE_SIZE; ++i) {
-      for (struct tex_entity* entity = tex.entity[i]; entity; entity = entity->next) {
-        for (struct tex_animation* animation = entity->animation; animation; animation = animation->next) {
-          for (struct tex_frame* frame = animation->frame; frame; frame = frame->next) {
-            emit("  TF_%s,\n", frame->name);
-          }
+    for (struct tex_entity* entity = tex.entity; entity; entity = entity->next) {
+      for (struct tex_animation* animation = entity->animation; animation; animation = animation->next) {
+        for (struct tex_frame* frame = animation->frame; frame; frame = frame->next) {
+          emit("  TF_%s,\n", frame->name);
         }
       }
     }
@@ -447,15 +437,13 @@ ATS_API void tex_save(const char* name) {
   // entity -> animation lookup table:
   {
     emit("static u16 tex_animation_table[TE_count][TA_count] = {\n");
-    for (u32 i = 0; i < TEXTURE_TABLE_SIZE; ++i) {
-      for (struct tex_entity* entity = tex.entity[i]; entity; entity = entity->next) {
-        emit("  [TE_%s] = {\n", entity->name);
-        for (struct tex_animation* animation = entity->animation; animation; animation = animation->next) {
-          struct tex_frame* frame = animation->frame;
-          emit("    [TA_%s] = TF_%s,\n", animation->name, frame->name);
-        }
-        emit("  },\n");
+    for (struct tex_entity* entity = tex.entity; entity; entity = entity->next) {
+      emit("  [TE_%s] = {\n", entity->name);
+      for (struct tex_animation* animation = entity->animation; animation; animation = animation->next) {
+        struct tex_frame* frame = animation->frame;
+        emit("    [TA_%s] = TF_%s,\n", animation->name, frame->name);
       }
+      emit("  },\n");
     }
     emit("};\n\n");
   }
@@ -470,21 +458,19 @@ ATS_API void tex_save(const char* name) {
     emit("} tex_info;\n\n");
     emit("static tex_info tex_info_table[TF_count] = {\n");
 
-    for (u32 i = 0; i < TEXTURE_TABLE_SIZE; ++i) {
-      for (struct tex_entity* entity = tex.entity[i]; entity; entity = entity->next) {
-        for (struct tex_animation* animation = entity->animation; animation; animation = animation->next) {
-          for (struct tex_frame* frame = animation->frame; frame; frame = frame->next) {
-            tex_rect rect = frame->rect;
-            tex_rect fitted = frame->fitted;
-            struct tex_frame* next = frame->next? frame->next : animation->frame;
-
-            emit("  [TF_%s] = {\n", frame->name),
-            emit("    .next_frame = TF_%s,\n", next->name);
-            emit("    .animation  = TA_%s,\n", animation->name);
-            emit("    .rect       = { %d, %d, %d, %d },\n", rect.min_x, rect.min_y, rect.max_x, rect.max_y);
-            emit("    .fitted     = { %d, %d, %d, %d },\n", fitted.min_x, fitted.min_y, fitted.max_x, fitted.max_y);
-            emit("  },\n");
-          }
+    for (struct tex_entity* entity = tex.entity; entity; entity = entity->next) {
+      for (struct tex_animation* animation = entity->animation; animation; animation = animation->next) {
+        for (struct tex_frame* frame = animation->frame; frame; frame = frame->next) {
+          tex_rect rect = frame->rect;
+          tex_rect fitted = frame->fitted;
+          struct tex_frame* next = frame->next? frame->next : animation->frame;
+
+          emit("  [TF_%s] = {\n", frame->name),
+          emit("    .next_frame = TF_%s,\n", next->name);
+          emit("    .animation  = TA_%s,\n", animation->name);
+          emit("    .rect       = { %d, %d, %d, %d },\n", rect.min_x, rect.min_y, rect.max_x, rect.max_y);
+          emit("    .fitted     = { %d, %d, %d, %d },\n", fitted.min_x, fitted.min_y, fitted.max_x, fitted.max_y);
+          emit("  },\n");
         }
       }
     }
@@ -2,6 +2,7 @@
 
 typedef struct {
   const char* name;
+  u32 id;             // intern id of 'name'
 
   f64 start;
   f64 stop;
@@ -19,24 +20,36 @@ static u32 timer_top;
 static u32 timer_count;
 static timer_entry timer_stack[512];
 static timer_entry timer_array[512];
-static timer_node timer_table[512];
 
+static u32 timer_index_cap;
+static u32* timer_index;   // intern id -> index into timer_table
+static u32 timer_node_count;
+static u32 timer_node_cap;
+static timer_node* timer_table;
+
+#ifdef _MSC_VER
 #define timer_scope(name) scope_guard(timer_start(name), timer_stop())
+#else
+// each call site interns its name the first time it runs, after that it only passes the id.
+// NOTE: 'name' has to be the same string every time, use timer_start for names built at runtime.
+#define timer_scope(name) \
+  scope_guard(timer_start_id(({ static u32 timer__id; if (!timer__id) timer__id = str_intern(name); timer__id; })), timer_stop())
+#endif
 
-static void timer_start(const char* name) {
+#define timer_scope_id(id) scope_guard(timer_start_id(id), timer_stop())
+
+// intern the name once and time by id, so per frame timers skip hashing the name.
+static void timer_start_id(u32 id) {
   timer_entry* entry = timer_stack + timer_top++;
-  entry->name = name;
+  entry->name = str_intern_get(id);
+  entry->id = id;
   entry->start = platform_get_time();
   entry->stop = 0;
   entry->depth = timer_top - 1;
 }
 
-static timer_node* timer_node_next(timer_node* node) {
-  node++;
-  if (node >= (timer_table + 512)) {
-    node = timer_table;
-  }
-  return node;
+static void timer_start(const char* name) {
+  timer_start_id(str_intern(name));
 }
 
 static void timer_stop(void) {
@@ -46,18 +59,28 @@ static void timer_stop(void) {
   timer_array[timer_count++] = *entry;
 
   {
-    u32 hash = hash_str(entry->name);
-    u32 index = hash & 511;
-    timer_node* node = &timer_table[index];
-
-    while (node->name && (strcmp(entry->name, node->name) != 0)) {
-      node = timer_node_next(node);
+    if (entry->id >= timer_index_cap) {
+      u32 cap = max(max(timer_index_cap << 1, str_intern_count() + 1), 64);
+      timer_index = realloc(timer_index, cap * sizeof (u32));
+      memset(timer_index + timer_index_cap, 0, (cap - timer_index_cap) * sizeof (u32));
+      timer_index_cap = cap;
     }
 
-    if (!node->name) {
-      node->name = entry->name;
+    u32* value = &timer_index[entry->id];
+
+    // values are index + 1, 0 is a new name.
+    if (!*value) {
+      if (timer_node_count == timer_node_cap) {
+        timer_node_cap = max(timer_node_cap << 1, 64);
+        timer_table = realloc(timer_table, timer_node_cap * sizeof (timer_node));
+      }
+
+      timer_table[timer_node_count] = (timer_node) { entry->name, 0, 0 };
+      *value = ++timer_node_count;
     }
 
+    timer_node* node = &timer_table[*value - 1];
+
     node->current = entry->stop - entry->start;
 
     if (node->max < node->current) {
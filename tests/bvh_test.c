@@ -0,0 +1,317 @@
+// bvh queries have to match brute force after random inserts, moves and removes, and the tree has to
+// stay linked, fitted and balanced. then times bvh_query_box against sm_in_range on mixed object sizes.
+// build: cc -std=gnu11 -O2 tests/bvh_test.c -lm -lpthread && ./a.out
+
+#include "../ats.h"
+#include "../ats_math.c"
+#include "../ats_mem.c"
+#include "../ats_ds.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#define ENTITY_COUNT (2000)
+#define WORLD_SIZE   (500.0f)
+
+typedef struct {
+  r3 box;
+  u32 id;
+  b32 alive;
+} entity;
+
+static entity entities[ENTITY_COUNT];
+static void* out[ENTITY_COUNT];
+static void* expected[ENTITY_COUNT];
+static bvh_pair pairs[ENTITY_COUNT * 64];
+static bvh_pair expected_pairs[ENTITY_COUNT * 64];
+
+static f64 now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// mostly small boxes with a few huge ones, the case the tree is meant for.
+static r3 random_box(void) {
+  f32 size = rand_u32() % 16 == 0? rand_f32(20, 150) : rand_f32(0.2f, 4);
+  v2 pos = v2(rand_f32(0, WORLD_SIZE), rand_f32(0, WORLD_SIZE));
+  r2 rect = r2(pos, v2(pos.x + size * rand_f32(0.3f, 1), pos.y + size * rand_f32(0.3f, 1)));
+  return bvh_r2(rect);
+}
+
+static int ptr_cmp(const void* va, const void* vb) {
+  uintptr_t a = (uintptr_t)*(void**)va;
+  uintptr_t b = (uintptr_t)*(void**)vb;
+  return a < b? -1 : a > b;
+}
+
+static int pair_cmp(const void* va, const void* vb) {
+  const bvh_pair* a = va;
+  const bvh_pair* b = vb;
+  if (a->a != b->a) return (uintptr_t)a->a < (uintptr_t)b->a? -1 : 1;
+  if (a->b != b->b) return (uintptr_t)a->b < (uintptr_t)b->b? -1 : 1;
+  return 0;
+}
+
+static u32 compare(const char* name, void** a, u32 a_count, void** b, u32 b_count) {
+  sort(a, a_count, ptr_cmp);
+  sort(b, b_count, ptr_cmp);
+
+  b32 same = a_count == b_count;
+  for (u32 i = 0; same && i < a_count; ++i) {
+    same = a[i] == b[i];
+  }
+  if (same) return 0;
+
+  printf("%s: bvh found %u, brute force %u\n", name, a_count, b_count);
+  return 1;
+}
+
+// returns the height of the subtree, checks links, fitted boxes and balance on the way.
+static i32 check_node(bvh_tree* tree, u32 index, u32 parent, u32* leaf_count, u32* errors) {
+  bvh_node* node = &tree->nodes[index];
+
+  if (node->parent != parent) (*errors)++;
+
+  if (node->height == 0) {
+    if (!bvh__encloses(node->box, node->rect)) (*errors)++;
+    (*leaf_count)++;
+    return 0;
+  }
+
+  i32 left = check_node(tree, node->left, index, leaf_count, errors);
+  i32 right = check_node(tree, node->right, index, leaf_count, errors);
+
+  if (node->height != 1 + max(left, right)) (*errors)++;
+  if (abs(left - right) > 1) (*errors)++;
+  if (!bvh__encloses(node->box, tree->nodes[node->left].box) || !bvh__encloses(node->box, tree->nodes[node->right].box)) (*errors)++;
+
+  return node->height;
+}
+
+static u32 check_tree(bvh_tree* tree) {
+  u32 errors = 0;
+  u32 leaf_count = 0;
+
+  if (tree->root != BVH_NULL) {
+    check_node(tree, tree->root, BVH_NULL, &leaf_count, &errors);
+  }
+  if (leaf_count != tree->count) errors++;
+
+  if (errors) printf("tree: %u broken nodes\n", errors);
+  return errors;
+}
+
+static u32 check_queries(bvh_tree* tree) {
+  u32 errors = 0;
+
+  for (u32 q = 0; q < 50; ++q) {
+    r3 box = random_box();
+    void* ignore = &entities[rand_u32() % ENTITY_COUNT];
+
+    u32 count = bvh_query_box(tree, box, ignore, out, countof(out));
+    u32 expected_count = 0;
+    for_array(i, entities) {
+      entity* e = &entities[i];
+      if (e->alive && e != ignore && r3_intersect(e->box, box)) expected[expected_count++] = e;
+    }
+    errors += compare("bvh_query_box", out, count, expected, expected_count);
+
+    v3 point = v3(rand_f32(0, WORLD_SIZE), rand_f32(0, WORLD_SIZE), 0);
+    count = bvh_query_point(tree, point, out, countof(out));
+    expected_count = 0;
+    for_array(i, entities) {
+      entity* e = &entities[i];
+      if (e->alive && r3_contains(e->box, point)) expected[expected_count++] = e;
+    }
+    errors += compare("bvh_query_point", out, count, expected, expected_count);
+
+    v3 pos = v3(rand_f32(0, WORLD_SIZE), rand_f32(0, WORLD_SIZE), 0);
+    v3 dir = v3(rand_f32(-1, 1), rand_f32(-1, 1), 0);
+    v3 inv_dir = { 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+    f32 max_t = rand_f32(10, 300);
+
+    count = bvh_query_ray(tree, pos, dir, max_t, out, countof(out));
+    expected_count = 0;
+    f32 closest = max_t;
+    void* closest_e = 0;
+    for_array(i, entities) {
+      entity* e = &entities[i];
+      f32 t;
+      if (!e->alive || !bvh__ray_box(e->box, pos, inv_dir, max_t, &t)) continue;
+      expected[expected_count++] = e;
+      if (t <= closest) {
+        closest = t;
+        closest_e = e;
+      }
+    }
+    errors += compare("bvh_query_ray", out, count, expected, expected_count);
+
+    f32 t = 0;
+    void* hit = bvh_raycast(tree, pos, dir, max_t, 0, &t);
+    if (!!hit != !!closest_e || (hit && t != closest)) {
+      printf("bvh_raycast: hit %d at %f, brute force %d at %f\n", !!hit, t, !!closest_e, closest);
+      errors++;
+    }
+  }
+
+  // every overlapping pair exactly once.
+  u32 count = bvh_query_pairs(tree, pairs, countof(pairs));
+  for (u32 i = 0; i < count; ++i) {
+    if ((uintptr_t)pairs[i].a > (uintptr_t)pairs[i].b) swap(void*, pairs[i].a, pairs[i].b);
+  }
+
+  u32 expected_count = 0;
+  for (u32 i = 0; i < ENTITY_COUNT; ++i) {
+    for (u32 j = i + 1; j < ENTITY_COUNT; ++j) {
+      if (!entities[i].alive || !entities[j].alive || !r3_intersect(entities[i].box, entities[j].box)) continue;
+      expected_pairs[expected_count++] = (bvh_pair) { &entities[i], &entities[j] };
+    }
+  }
+
+  sort(pairs, count, pair_cmp);
+  sort(expected_pairs, expected_count, pair_cmp);
+
+  b32 same = count == expected_count;
+  for (u32 i = 0; same && i < count; ++i) {
+    same = !pair_cmp(&pairs[i], &expected_pairs[i]);
+  }
+  if (!same) {
+    printf("bvh_query_pairs: bvh found %u, brute force %u\n", count, expected_count);
+    errors++;
+  }
+
+  return errors + check_tree(tree);
+}
+
+static void insert(bvh_tree* tree, entity* e) {
+  e->box = random_box();
+  e->id = bvh_insert(tree, e, e->box);
+  e->alive = 1;
+}
+
+static void timing(mem_arena* arena) {
+  static r2 rects[20000];
+  static r2 queries[4096];
+
+  bvh_tree tree = bvh_create(arena, 0.5f);
+  spatial_map map = {0};
+  sm_init(&map, arena, 8.0f);
+
+  for_array(i, rects) {
+    r3 box = random_box();
+    rects[i] = r2(v2(box.min.x, box.min.y), v2(box.max.x, box.max.y));
+  }
+  for_array(i, queries) {
+    v2 pos = v2(rand_f32(0, WORLD_SIZE), rand_f32(0, WORLD_SIZE));
+    queries[i] = r2(pos, v2(pos.x + rand_f32(1, 16), pos.y + rand_f32(1, 16)));
+  }
+
+  f64 start = now();
+  for_array(i, rects) bvh_insert(&tree, &rects[i], bvh_r2(rects[i]));
+  f64 bvh_build = now() - start;
+
+  start = now();
+  for_array(i, rects) sm_add(&map, &rects[i], rects[i]);
+  f64 sm_build = now() - start;
+
+  u64 bvh_hits = 0;
+  start = now();
+  for_array(i, queries) {
+    bvh_hits += bvh_query_box(&tree, bvh_r2(queries[i]), 0, out, countof(out));
+  }
+  f64 bvh_query = now() - start;
+
+  u64 sm_hits = 0;
+  start = now();
+  mem_scope(.arena = arena) {
+    mem_push(arena);
+    for_array(i, queries) {
+      v2 rad = v2_scale(v2_sub(queries[i].max, queries[i].min), 0.5f);
+      for (sm_node* it = sm_in_range(&map, v2_add(queries[i].min, rad), rad, 0); it; it = it->next) sm_hits++;
+    }
+    mem_pop();
+  }
+  f64 sm_query = now() - start;
+
+  printf("%u mixed size entities, %u box queries (%llu / %llu hits)\n", (u32)countof(rects), (u32)countof(queries), (unsigned long long)bvh_hits, (unsigned long long)sm_hits);
+  printf("  bvh:         build %.2f ms, queries %.2f ms\n", bvh_build * 1e3, bvh_query * 1e3);
+  printf("  spatial_map: build %.2f ms, sm_in_range %.2f ms\n", sm_build * 1e3, sm_query * 1e3);
+}
+
+int main(void) {
+  mem_arena arena = mem_reserve(MEM_GIB(1));
+  u32 errors = 0;
+
+  bvh_tree tree = bvh_create(&arena, 0.5f);
+
+  for (u32 round = 0; round < 4; ++round) {
+    for_array(i, entities) insert(&tree, &entities[i]);
+    errors += check_queries(&tree);
+
+    for (u32 step = 0; step < 20; ++step) {
+      for (u32 i = 0; i < ENTITY_COUNT / 4; ++i) {
+        entity* e = &entities[rand_u32() % ENTITY_COUNT];
+        u32 action = rand_u32() % 8;
+
+        if (!e->alive) {
+          insert(&tree, e);
+        } else if (action == 0) {
+          bvh_remove(&tree, e->id);
+          e->alive = 0;
+        } else {
+          // small steps mostly stay inside the fat box, teleports always reinsert.
+          b32 teleport = action == 1;
+          v3 offset = teleport? v3(rand_f32(-200, 200), rand_f32(-200, 200), 0) : v3(rand_f32(-0.4f, 0.4f), rand_f32(-0.4f, 0.4f), 0);
+          r3 box = { v3_add(e->box.min, offset), v3_add(e->box.max, offset) };
+
+          b32 reinserted = bvh_move(&tree, e->id, box);
+          b32 inside = bvh__encloses(tree.nodes[e->id].box, box);
+          if (!inside || (teleport && !reinserted)) {
+            printf("bvh_move: leaf box doesn't hold the moved box\n");
+            errors++;
+          }
+          e->box = box;
+        }
+      }
+      errors += check_queries(&tree);
+    }
+
+    // down to an empty tree, the free nodes get reused by the next round.
+    u32 node_count = tree.node_count;
+    for_array(i, entities) {
+      if (!entities[i].alive) continue;
+      bvh_remove(&tree, entities[i].id);
+      entities[i].alive = 0;
+    }
+    if (tree.root != BVH_NULL || tree.count || bvh_query_box(&tree, r3(v3(0, 0, 0), v3(WORLD_SIZE, WORLD_SIZE, 0)), 0, out, countof(out))) {
+      printf("empty tree: root %u count %u\n", tree.root, tree.count);
+      errors++;
+    }
+    errors += check_queries(&tree);
+
+    for_array(i, entities) insert(&tree, &entities[i]);
+    if (tree.node_count != node_count) {
+      printf("free nodes not reused: %u nodes, was %u\n", tree.node_count, node_count);
+      errors++;
+    }
+    for_array(i, entities) {
+      bvh_remove(&tree, entities[i].id);
+      entities[i].alive = 0;
+    }
+  }
+
+  // boxes inserted in order along a line, the worst case for a tree that doesn't rebalance.
+  for_array(i, entities) {
+    entity* e = &entities[i];
+    e->box = r3(v3(i * 0.25f, 0, 0), v3(i * 0.25f + 0.2f, 1, 0));
+    e->id = bvh_insert(&tree, e, e->box);
+    e->alive = 1;
+  }
+  errors += check_queries(&tree);
+
+  timing(&arena);
+
+  printf("bvh_test: %u errors\n", errors);
+  return errors != 0;
+}
@@ -0,0 +1,110 @@
+// hpa_find has to find a path whenever path_find does.
+// build: cc -std=gnu11 -O2 tests/hpa_test.c -lm -lpthread && ./a.out
+
+#include "../ats.h"
+#include "../ats_math.c"
+#include "../ats_mem.c"
+#include "../ats_ds.c"
+
+#include <stdio.h>
+
+#define MAP_W 300
+#define MAP_H 260
+
+static u32 passable[(MAP_W * MAP_H + 31) / 32];
+static v2i waypoints[4096];
+
+static void fill(i32 x0, i32 y0, i32 x1, i32 y1, b32 open) {
+  for (i32 y = max(y0, 0); y < min(y1, MAP_H); ++y) {
+    for (i32 x = max(x0, 0); x < min(x1, MAP_W); ++x) {
+      if (open) bit_set(passable, (u32)(x + y * MAP_W));
+      else      bit_clr(passable, (u32)(x + y * MAP_W));
+    }
+  }
+}
+
+static u32 compare(path_grid* grid, hpa_map* hpa, v2i start, v2i goal) {
+  b32 expected = path_find(grid, start, goal, PATH_FLAG_DIAGONAL, 0, 0) != 0;
+  b32 found = hpa_find(hpa, start, goal, waypoints, countof(waypoints)) != 0;
+
+  if (expected == found) return 0;
+
+  printf("hpa_find %s: (%d, %d) -> (%d, %d)\n", found? "found a path that doesn't exist" : "missed a path", start.x, start.y, goal.x, goal.y);
+  return 1;
+}
+
+int main(void) {
+  mem_arena arena = mem_reserve(MEM_GIB(1));
+  u32 errors = 0;
+
+  path_grid grid = path_grid_create(&arena, MAP_W, MAP_H, passable);
+  hpa_map hpa = hpa_create(&arena, MAP_W, MAP_H, passable);
+
+  static v2i all[MAP_W * MAP_H];
+  for (i32 i = 0; i < MAP_W * MAP_H; ++i) {
+    all[i] = v2i(i % MAP_W, i / MAP_W);
+  }
+
+  // every other row open and one column joining them: each row crosses the cluster borders
+  // through more entrances than a fixed per border limit would keep.
+  fill(0, 0, MAP_W, MAP_H, 0);
+  for (i32 y = 0; y < MAP_H; y += 2) fill(0, y, MAP_W, y + 1, 1);
+  fill(0, 0, 1, MAP_H, 1);
+  hpa_update(&hpa, all, countof(all));
+
+  for (i32 y = 0; y < MAP_H; y += 2) {
+    errors += compare(&grid, &hpa, v2i(MAP_W - 1, 0), v2i(MAP_W - 1, y));
+  }
+
+  // random walls.
+  for (u32 round = 0; round < 8; ++round) {
+    fill(0, 0, MAP_W, MAP_H, 1);
+    for (u32 i = 0; i < 300; ++i) {
+      i32 x = rand_i32(0, MAP_W - 1);
+      i32 y = rand_i32(0, MAP_H - 1);
+      i32 w = rand_i32(1, 25);
+      i32 h = rand_i32(1, 4);
+      if (i & 1) fill(x, y, x + h, y + w, 0);
+      else       fill(x, y, x + w, y + h, 0);
+    }
+    hpa_update(&hpa, all, countof(all));
+
+    for (u32 i = 0; i < 200; ++i) {
+      v2i start = v2i(rand_i32(0, MAP_W - 1), rand_i32(0, MAP_H - 1));
+      v2i goal = v2i(rand_i32(0, MAP_W - 1), rand_i32(0, MAP_H - 1));
+      errors += compare(&grid, &hpa, start, goal);
+    }
+  }
+
+  // small walls added and removed a few at a time, so only some clusters are rebuilt and the costs of
+  // the others have to move around them as entrance counts change.
+  for (u32 round = 0; round < 200; ++round) {
+    v2i changed[64];
+    u32 changed_count = 0;
+
+    for (u32 i = 0; i < 4; ++i) {
+      i32 x = rand_i32(0, MAP_W - 4);
+      i32 y = rand_i32(0, MAP_H - 4);
+      b32 open = rand_u32() & 1;
+      fill(x, y, x + 4, y + 4, open);
+      for (i32 j = 0; j < 16; ++j) changed[changed_count++] = v2i(x + j % 4, y + j / 4);
+    }
+    hpa_update(&hpa, changed, changed_count);
+
+    for (u32 i = 0; i < 10; ++i) {
+      v2i start = v2i(rand_i32(0, MAP_W - 1), rand_i32(0, MAP_H - 1));
+      v2i goal = v2i(rand_i32(0, MAP_W - 1), rand_i32(0, MAP_H - 1));
+      errors += compare(&grid, &hpa, start, goal);
+    }
+  }
+
+  u32 cost_count = 0;
+  for (i32 i = 0; i < hpa.clusters_x * hpa.clusters_y; ++i) {
+    cost_count += hpa.clusters[i].cost_count * hpa.clusters[i].cost_count;
+  }
+  printf("costs: %u bytes used, %u reserved, %u for a full matrix per cluster\n", cost_count * 4, hpa.cost_cap * 4,
+         (u32)(hpa.clusters_x * hpa.clusters_y * HPA_CLUSTER_NODES * HPA_CLUSTER_NODES * 4));
+
+  printf("hpa_test: %u errors\n", errors);
+  return errors != 0;
+}
@@ -0,0 +1,106 @@
+// mem_alloc throughput on one concurrent arena from 1, 2, 4 and 8 threads, against a plain
+// arena behind a lock. also checks that no two threads were handed overlapping memory.
+// build: cc -std=gnu11 -O2 tests/mem_concurrent_bench.c -lm -lpthread && ./a.out
+
+#include "../ats.h"
+#include "../ats_math.c"
+#include "../ats_mem.c"
+#include "../ats_ds.c"
+
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#define ALLOC_COUNT (1 << 20) // per thread
+#define MAX_THREADS (8)
+
+static mem_arena shared;
+static volatile i32 shared_lock;
+static b32 use_lock;
+
+static u64* allocs[MAX_THREADS];
+
+static f64 now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void* work(void* arg) {
+  u64 index = (u64)(uintptr_t)arg;
+
+  for (u32 i = 0; i < ALLOC_COUNT; ++i) {
+    u64* ptr;
+    if (use_lock) {
+      mem__lock(&shared_lock);
+      ptr = mem_array(u64, 4, &shared, .flags = MEM_ALLOC_NO_ZERO);
+      mem__unlock(&shared_lock);
+    } else {
+      ptr = mem_array(u64, 4, &shared, .flags = MEM_ALLOC_NO_ZERO);
+    }
+
+    ptr[0] = ptr[1] = ptr[2] = ptr[3] = (index << 32) | i;
+
+    // every 64th allocation is kept so the overlap check stays cheap.
+    if (!(i & 63)) allocs[index][i >> 6] = (u64)(uintptr_t)ptr;
+  }
+  return 0;
+}
+
+// runs 'thread_count' threads and returns millions of allocations per second.
+static f64 run(u32 thread_count, u32* errors) {
+  pthread_t threads[MAX_THREADS];
+
+  mem_save(&shared);
+
+  f64 start = now();
+  for (u32 i = 0; i < thread_count; ++i) {
+    pthread_create(&threads[i], 0, work, (void*)(uintptr_t)i);
+  }
+  for (u32 i = 0; i < thread_count; ++i) {
+    pthread_join(threads[i], 0);
+  }
+  f64 seconds = now() - start;
+
+  for (u32 t = 0; t < thread_count; ++t) {
+    for (u32 i = 0; i < ALLOC_COUNT; i += 64) {
+      u64* ptr = (u64*)(uintptr_t)allocs[t][i >> 6];
+      u64 expected = ((u64)t << 32) | i;
+      if (ptr[0] != expected || ptr[3] != expected) {
+        printf("thread %u allocation %u was overwritten\n", t, i);
+        (*errors)++;
+      }
+    }
+  }
+
+  mem_restore(&shared);
+  return thread_count * (f64)ALLOC_COUNT / seconds / 1e6;
+}
+
+int main(void) {
+  u32 errors = 0;
+
+  for (u32 i = 0; i < MAX_THREADS; ++i) {
+    allocs[i] = calloc(ALLOC_COUNT / 64, sizeof (u64));
+  }
+
+  shared = mem_reserve(MEM_GIB(4));
+
+  printf("threads   locked arena   concurrent arena   (M allocs/s)\n");
+  for (u32 thread_count = 1; thread_count <= MAX_THREADS; thread_count <<= 1) {
+    shared.flags &= ~MEM_FLAG_CONCURRENT;
+    use_lock = 1;
+    f64 locked = run(thread_count, &errors);
+
+    mem_set_concurrent(&shared);
+    use_lock = 0;
+    f64 concurrent = run(thread_count, &errors);
+
+    printf("%7u   %12.1f   %16.1f\n", thread_count, locked, concurrent);
+  }
+
+  mem_release(&shared);
+
+  printf("mem_concurrent_bench: %u errors\n", errors);
+  return errors != 0;
+}
@@ -0,0 +1,108 @@
+// ray_cast_batch has to give the same hits as a ray_iter loop, and be faster than one. build it once
+// with AVX2 and once without, the scalar build is the fallback ray_cast_batch uses on other targets.
+// build: cc -std=gnu11 -O2 -mavx2 -mfma tests/ray_cast_bench.c -lm -lpthread && ./a.out
+//        cc -std=gnu11 -O2 tests/ray_cast_bench.c -lm -lpthread && ./a.out
+
+#include "../ats.h"
+#include "../ats_math.c"
+#include "../ats_mem.c"
+#include "../ats_ds.c"
+
+#include <stdio.h>
+#include <time.h>
+
+#define MAP_W     (1024)
+#define MAP_H     (1024)
+#define RAY_COUNT (1920) // one per column of a 1080p screen
+#define MAX_DIST  (200.0f)
+
+static u32 solid[MAP_W * MAP_H / 32];
+
+static v2 pos[RAY_COUNT];
+static v2 dir[RAY_COUNT];
+static ray_hit expected[RAY_COUNT];
+static ray_hit hits[RAY_COUNT];
+
+static f64 now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// the loop ray_cast_batch replaces.
+static ray_hit cast(v2 p, v2 d) {
+  ray_iter(it, p, d) {
+    f32 dist = it.side == 0? it.side_dist_x - it.delta_dist_x : it.side_dist_y - it.delta_dist_y;
+
+    if ((u32)it.map_x >= MAP_W || (u32)it.map_y >= MAP_H || dist > MAX_DIST) {
+      return (ray_hit) { 0, dist, it.map_x, it.map_y, it.side };
+    }
+    if (bit_get(solid, (u32)(it.map_x + it.map_y * MAP_W))) {
+      return (ray_hit) { 1, dist, it.map_x, it.map_y, it.side };
+    }
+  }
+  return (ray_hit) { 0, 0, 0, 0, 0 };
+}
+
+static u32 compare(u32 count) {
+  u32 errors = 0;
+  for (u32 i = 0; i < count; ++i) {
+    if (memcmp(&hits[i], &expected[i], sizeof (ray_hit))) errors++;
+  }
+  if (errors) printf("%u of %u rays differ from ray_iter\n", errors, count);
+  return errors;
+}
+
+int main(void) {
+  u32 errors = 0;
+
+  for (u32 i = 0; i < MAP_W * MAP_H; ++i) {
+    if (rand_u32() % 100 == 0) bit_set(solid, i);
+  }
+
+  // some rays start outside the map, some are axis aligned.
+  for (u32 i = 0; i < RAY_COUNT; ++i) {
+    f32 angle = rand_f32(0, 6.2831853f);
+    pos[i] = v2(rand_f32(-50, MAP_W), rand_f32(100, MAP_H - 100));
+    dir[i] = v2(cosf(angle), sinf(angle));
+    if (i % 97 == 0) dir[i] = v2(1, 0);
+    if (i % 89 == 0) dir[i] = v2(0, -1);
+  }
+
+  f64 iter_time = 1e9;
+  f64 batch_time = 1e9;
+
+  for (u32 round = 0; round < 5; ++round) {
+    f64 start = now();
+    for (u32 rep = 0; rep < 20; ++rep) {
+      for (u32 i = 0; i < RAY_COUNT; ++i) expected[i] = cast(pos[i], dir[i]);
+    }
+    f64 mid = now();
+    for (u32 rep = 0; rep < 20; ++rep) {
+      ray_cast_batch(pos, dir, RAY_COUNT, solid, MAP_W, MAP_H, MAX_DIST, hits);
+    }
+    f64 end = now();
+
+    iter_time = min(iter_time, (mid - start) / 20);
+    batch_time = min(batch_time, (end - mid) / 20);
+  }
+  errors += compare(RAY_COUNT);
+
+  // counts that don't fill the lanes.
+  for (u32 count = 0; count < 12; ++count) {
+    memset(hits, 0x55, sizeof hits);
+    ray_cast_batch(pos, dir, count, solid, MAP_W, MAP_H, MAX_DIST, hits);
+    errors += compare(count);
+  }
+
+#ifdef __AVX2__
+  const char* path = "avx2";
+#else
+  const char* path = "scalar";
+#endif
+
+  printf("%u rays: ray_iter %.3f ms, ray_cast_batch (%s) %.3f ms, %.2fx\n", RAY_COUNT, iter_time * 1e3, path, batch_time * 1e3, iter_time / batch_time);
+
+  printf("ray_cast_bench: %u errors\n", errors);
+  return errors != 0;
+}
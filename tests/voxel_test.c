@@ -0,0 +1,167 @@
+// voxel_map_cast has to hit the same voxel as walking every cell with ray3_iter.
+// build: cc -std=gnu11 -O2 tests/voxel_test.c -lm -lpthread && ./a.out
+
+#include "../ats.h"
+#include "../ats_math.c"
+#include "../ats_mem.c"
+#include "../ats_ds.c"
+
+#include <stdio.h>
+
+static v3i size;
+static u8* solid;
+
+static b32 solid_at(i32 x, i32 y, i32 z) {
+  return solid[x + size.x * (y + size.y * z)];
+}
+
+static void set(voxel_map* map, i32 x, i32 y, i32 z) {
+  solid[x + size.x * (y + size.y * z)] = 1;
+  voxel_map_set(map, v3i(x, y, z), 1);
+}
+
+// every cell along the ray with ray3_iter, the start cell is floored so rays can start below 0.
+static ray3_hit walk(v3 pos, v3 dir, f32 max_dist) {
+  ray3_hit result = {0};
+  ray3_iter it = ray3_iter_create(pos, dir);
+
+  it.map_x = (i32)floorf(pos.x);
+  it.map_y = (i32)floorf(pos.y);
+  it.map_z = (i32)floorf(pos.z);
+  it.side_dist_x = (dir.x < 0? pos.x - it.map_x : it.map_x + 1.0f - pos.x) * it.delta_dist_x;
+  it.side_dist_y = (dir.y < 0? pos.y - it.map_y : it.map_y + 1.0f - pos.y) * it.delta_dist_y;
+  it.side_dist_z = (dir.z < 0? pos.z - it.map_z : it.map_z + 1.0f - pos.z) * it.delta_dist_z;
+
+  b32 entered = 0;
+  for (;; ray3_iter_advance(&it)) {
+    f32 dist = it.side == 0? it.side_dist_x - it.delta_dist_x : it.side == 1? it.side_dist_y - it.delta_dist_y : it.side_dist_z - it.delta_dist_z;
+    if (dist > max_dist) break;
+
+    if ((u32)it.map_x >= (u32)size.x || (u32)it.map_y >= (u32)size.y || (u32)it.map_z >= (u32)size.z) {
+      if (entered) break;
+      continue;
+    }
+    entered = 1;
+
+    if (solid_at(it.map_x, it.map_y, it.map_z)) {
+      result.hit = 1;
+      result.dist = dist;
+      result.map_x = it.map_x;
+      result.map_y = it.map_y;
+      result.map_z = it.map_z;
+      break;
+    }
+  }
+  return result;
+}
+
+// the same walk in doubles, breaks the ties where the f32 walk rounds to the other cell.
+static ray3_hit walk_exact(v3 pos, v3 dir, f32 max_dist) {
+  ray3_hit result = {0};
+  f64 p[3] = { pos.x, pos.y, pos.z };
+  f64 d[3] = { dir.x, dir.y, dir.z };
+  f64 side_dist[3], delta[3];
+  i32 cell[3], step[3];
+
+  for (i32 axis = 0; axis < 3; ++axis) {
+    cell[axis] = (i32)floor(p[axis]);
+    step[axis] = d[axis] < 0? -1 : 1;
+    delta[axis] = d[axis] == 0? 1e300 : fabs(1.0 / d[axis]);
+    side_dist[axis] = d[axis] == 0? 1e300 : ((cell[axis] + (step[axis] > 0)) - p[axis]) / d[axis];
+  }
+
+  b32 entered = 0;
+  f64 dist = 0;
+  for (;;) {
+    if (dist > max_dist) break;
+
+    if ((u32)cell[0] >= (u32)size.x || (u32)cell[1] >= (u32)size.y || (u32)cell[2] >= (u32)size.z) {
+      if (entered) break;
+    } else {
+      entered = 1;
+      if (solid_at(cell[0], cell[1], cell[2])) {
+        result.hit = 1;
+        result.dist = (f32)dist;
+        result.map_x = cell[0];
+        result.map_y = cell[1];
+        result.map_z = cell[2];
+        break;
+      }
+    }
+
+    i32 axis = side_dist[0] < side_dist[1]? (side_dist[0] < side_dist[2]? 0 : 2) : (side_dist[1] < side_dist[2]? 1 : 2);
+    dist = side_dist[axis];
+    side_dist[axis] += delta[axis];
+    cell[axis] += step[axis];
+  }
+  return result;
+}
+
+static b32 same(ray3_hit a, ray3_hit b) {
+  return a.hit == b.hit && (!a.hit || (a.map_x == b.map_x && a.map_y == b.map_y && a.map_z == b.map_z));
+}
+
+static u32 compare(voxel_map* map, v3 pos, v3 dir, f32 max_dist) {
+  ray3_hit cast = voxel_map_cast(map, pos, dir, max_dist);
+  ray3_hit expected = walk(pos, dir, max_dist);
+
+  if (same(cast, expected) || same(cast, walk_exact(pos, dir, max_dist))) return 0;
+
+  printf("map %d %d %d pos %f %f %f dir %f %f %f: cast %d (%d, %d, %d), ray3_iter %d (%d, %d, %d)\n",
+         size.x, size.y, size.z, pos.x, pos.y, pos.z, dir.x, dir.y, dir.z,
+         cast.hit, cast.map_x, cast.map_y, cast.map_z, expected.hit, expected.map_x, expected.map_y, expected.map_z);
+  return 1;
+}
+
+static v3 random_outside(void) {
+  for (;;) {
+    v3 pos = v3(rand_f32(-40, size.x + 40.0f), rand_f32(-40, size.y + 40.0f), rand_f32(-40, size.z + 40.0f));
+    if (pos.x < 0 || pos.x >= size.x || pos.y < 0 || pos.y >= size.y || pos.z < 0 || pos.z >= size.z) return pos;
+  }
+}
+
+int main(void) {
+  mem_arena arena = mem_reserve(MEM_GIB(2));
+  u32 errors = 0;
+
+  // a ray entering through the +x side that rounding used to push back out of the map.
+  size = v3i(100, 70, 130);
+  solid = calloc((usize)size.x * size.y * size.z, 1);
+
+  voxel_map map = voxel_map_create(&arena, size.x, size.y, size.z);
+  set(&map, 99, 58, 115);
+  errors += compare(&map, v3(100.059143f, 29.487267f, 121.186234f), v3(-0.023092f, 0.981076f, -0.183346f), 1000);
+
+  // sparse maps, so rays cross lots of empty regions, bricks and octants, from outside the map
+  // towards a random point or voxel inside it.
+  for (u32 round = 0; round < 20; ++round) {
+    size = v3i(rand_i32(20, 200), rand_i32(20, 200), rand_i32(20, 200));
+    free(solid);
+    solid = calloc((usize)size.x * size.y * size.z, 1);
+
+    map = voxel_map_create(&arena, size.x, size.y, size.z);
+
+    v3i voxels[32];
+    u32 voxel_count = 1 + rand_u32() % countof(voxels);
+    for (u32 i = 0; i < voxel_count; ++i) {
+      voxels[i] = v3i(rand_i32(0, size.x), rand_i32(0, size.y), rand_i32(0, size.z));
+      set(&map, voxels[i].x, voxels[i].y, voxels[i].z);
+    }
+
+    for (u32 i = 0; i < 50000; ++i) {
+      v3 target = v3(rand_f32(0, size.x), rand_f32(0, size.y), rand_f32(0, size.z));
+      if (i & 1) {
+        v3i voxel = voxels[rand_u32() % voxel_count];
+        target = v3(voxel.x + rand_f32(0, 1), voxel.y + rand_f32(0, 1), voxel.z + rand_f32(0, 1));
+      }
+
+      v3 pos = random_outside();
+      errors += compare(&map, pos, v3_norm(v3_sub(target, pos)), 2000);
+    }
+  }
+
+  free(solid);
+
+  printf("voxel_test: %u errors\n", errors);
+  return errors != 0;
+}